@@ -0,0 +1,163 @@
+// atlas.h - Empaquetado de imagenes en paginas de textura (skyline)
+//
+// Todas las imagenes de una tanda se ubican en una o pocas paginas RGBA8 y
+// cada una recibe su rectangulo UV dentro de la pagina. Asi los sprites de la
+// escena comparten una sola textura: pasar de uno a otro no cambia el bind.
+//
+// Colocacion "skyline bottom-left": la pagina guarda el perfil superior de lo
+// ya ubicado como segmentos horizontales y cada imagen va donde su borde de
+// arriba queda mas bajo. Se prueban paginas cuadradas potencia de 2 desde la
+// mas chica que alcance hasta tamMax; si no entra todo en una de tamMax, se
+// abren mas.
+//
+// Cada imagen lleva MARGEN_ATLAS texels repitiendo su borde, para que el
+// filtrado bilineal y los primeros mipmaps no mezclen sprites vecinos. Una
+// imagen sola no necesita margen: la pagina es la imagen y GL_REPEAT sigue
+// funcionando como sin atlas.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#define MARGEN_ATLAS 4      // tambien es la alineacion: se conserva hasta el mip 2
+
+struct SegmentoHorizonte { int x, y, ancho; };
+
+struct PaginaAtlas {
+    int ancho = 0, alto = 0;
+    std::vector<uint32_t> texels;           // se puede liberar una vez subida
+    std::vector<SegmentoHorizonte> horizonte;
+};
+
+// Entrada: texels/ancho/alto. Salida: pagina y uv = {u0, v0, u1, v1}
+struct ImagenAtlas {
+    const uint32_t* texels;
+    int ancho, alto;
+    int pagina;
+    float uv[4];
+};
+
+// Alto al que quedaria un rectangulo de 'ancho' apoyado desde el segmento i, o -1
+inline int horizonteAjuste(const PaginaAtlas& p, size_t i, int ancho, int alto) {
+    int x = p.horizonte[i].x;
+    if (x + ancho > p.ancho) return -1;
+    int y = 0, resta = ancho;
+    for (size_t k = i; resta > 0; k++) {
+        y = std::max(y, p.horizonte[k].y);
+        resta -= p.horizonte[k].ancho;
+    }
+    return y + alto <= p.alto ? y : -1;
+}
+
+inline void horizonteOcupar(PaginaAtlas& p, size_t i, int y, int ancho, int alto) {
+    SegmentoHorizonte nuevo = { p.horizonte[i].x, y + alto, ancho };
+    p.horizonte.insert(p.horizonte.begin() + i, nuevo);
+    int fin = nuevo.x + ancho;
+    size_t k = i + 1;
+    while (k < p.horizonte.size() && p.horizonte[k].x < fin) {   // recortar lo que quedo tapado
+        SegmentoHorizonte& s = p.horizonte[k];
+        if (s.x + s.ancho <= fin) { p.horizonte.erase(p.horizonte.begin() + k); continue; }
+        s.ancho -= fin - s.x;
+        s.x = fin;
+        break;
+    }
+    for (size_t j = 0; j + 1 < p.horizonte.size(); ) {           // unir vecinos a la misma altura
+        if (p.horizonte[j].y == p.horizonte[j + 1].y) {
+            p.horizonte[j].ancho += p.horizonte[j + 1].ancho;
+            p.horizonte.erase(p.horizonte.begin() + j + 1);
+        } else j++;
+    }
+}
+
+// Busca lugar para ancho x alto; devuelve 0 si no entra
+inline int paginaUbicar(PaginaAtlas& p, int ancho, int alto, int& x, int& y) {
+    size_t mejor = 0;
+    int mejorTope = -1, mejorY = 0;
+    for (size_t i = 0; i < p.horizonte.size(); i++) {
+        int yi = horizonteAjuste(p, i, ancho, alto);
+        if (yi < 0) continue;
+        if (mejorTope < 0 || yi + alto < mejorTope) { mejor = i; mejorTope = yi + alto; mejorY = yi; }
+    }
+    if (mejorTope < 0) return 0;
+    x = p.horizonte[mejor].x; y = mejorY;
+    horizonteOcupar(p, mejor, y, ancho, alto);
+    return 1;
+}
+
+inline void paginaIniciar(PaginaAtlas& p, int ancho, int alto) {
+    p.ancho = ancho; p.alto = alto;
+    p.horizonte.assign(1, SegmentoHorizonte{0, 0, ancho});
+    p.texels.clear();
+}
+
+inline int tamConMargen(int dim) {
+    return (dim + 2 * MARGEN_ATLAS + MARGEN_ATLAS - 1) / MARGEN_ATLAS * MARGEN_ATLAS;
+}
+
+// Copia la imagen en (x, y) de la pagina estirando el borde sobre el margen
+inline void paginaCopiar(PaginaAtlas& p, const ImagenAtlas& img, int x, int y) {
+    for (int j = -MARGEN_ATLAS; j < img.alto + MARGEN_ATLAS; j++) {
+        int fy = std::min(std::max(j, 0), img.alto - 1);
+        uint32_t* d = &p.texels[(size_t)(y + j) * p.ancho + x];
+        const uint32_t* s = img.texels + (size_t)fy * img.ancho;
+        for (int i = -MARGEN_ATLAS; i < 0; i++) d[i] = s[0];
+        memcpy(d, s, (size_t)img.ancho * 4);
+        for (int i = img.ancho; i < img.ancho + MARGEN_ATLAS; i++) d[i] = s[img.ancho - 1];
+    }
+}
+
+// Ubica todas las imagenes (las mas altas primero, que deja menos huecos) y
+// llena paginas[].texels. Las paginas anteriores del vector no se tocan.
+inline void atlasEmpaquetar(std::vector<PaginaAtlas>& paginas, std::vector<ImagenAtlas>& imgs, int tamMax) {
+    if (imgs.empty()) return;
+    if (imgs.size() == 1) {
+        ImagenAtlas& img = imgs[0];
+        paginas.emplace_back();
+        PaginaAtlas& p = paginas.back();
+        paginaIniciar(p, img.ancho, img.alto);
+        p.texels.assign(img.texels, img.texels + (size_t)img.ancho * img.alto);
+        img.pagina = (int)paginas.size() - 1;
+        img.uv[0] = 0.0f; img.uv[1] = 0.0f; img.uv[2] = 1.0f; img.uv[3] = 1.0f;
+        return;
+    }
+    std::vector<int> orden(imgs.size());
+    for (size_t i = 0; i < orden.size(); i++) orden[i] = (int)i;
+    std::stable_sort(orden.begin(), orden.end(), [&](int a, int b) { return imgs[a].alto > imgs[b].alto; });
+
+    // la pagina mas chica en la que entra todo; si ninguna alcanza, varias de tamMax
+    int tam = 64;
+    for (; tam < tamMax; tam *= 2) {
+        PaginaAtlas prueba;
+        paginaIniciar(prueba, tam, tam);
+        int x, y;
+        bool entra = true;
+        for (int i : orden)
+            if (!paginaUbicar(prueba, tamConMargen(imgs[i].ancho), tamConMargen(imgs[i].alto), x, y)) { entra = false; break; }
+        if (entra) break;
+    }
+
+    size_t primera = paginas.size();
+    std::vector<int> xs(imgs.size()), ys(imgs.size());
+    for (int i : orden) {
+        int w = tamConMargen(imgs[i].ancho), h = tamConMargen(imgs[i].alto);
+        size_t k = primera;
+        for (; k < paginas.size(); k++) if (paginaUbicar(paginas[k], w, h, xs[i], ys[i])) break;
+        if (k == paginas.size()) {            // pagina nueva; una imagen mas grande que tamMax va sola en la suya
+            paginas.emplace_back();
+            paginaIniciar(paginas.back(), std::max(tam, w), std::max(tam, h));
+            paginaUbicar(paginas.back(), w, h, xs[i], ys[i]);
+        }
+        imgs[i].pagina = (int)k;
+    }
+    for (size_t k = primera; k < paginas.size(); k++) paginas[k].texels.assign((size_t)paginas[k].ancho * paginas[k].alto, 0);
+    for (size_t i = 0; i < imgs.size(); i++) {
+        ImagenAtlas& img = imgs[i];
+        PaginaAtlas& p = paginas[img.pagina];
+        int x = xs[i] + MARGEN_ATLAS, y = ys[i] + MARGEN_ATLAS;
+        paginaCopiar(p, img, x, y);
+        img.uv[0] = (float)x / p.ancho;              img.uv[1] = (float)y / p.alto;
+        img.uv[2] = (float)(x + img.ancho) / p.ancho; img.uv[3] = (float)(y + img.alto) / p.alto;
+    }
+}
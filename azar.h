@@ -0,0 +1,111 @@
+// azar.h - Numeros al azar por contador (Philox4x32-10)
+//
+// No hay estado que avance: el numero i de un flujo es una funcion pura de
+// (semilla, paso, efecto, i). La semilla distingue instancias de la escena
+// (sesiones del servidor), el paso es el frame de la historia y el efecto
+// separa a quien lo pide (fogonazo de cada soldado, particulas...). Asi el
+// mismo frame da los mismos numeros en cualquier hilo, en cualquier orden y
+// despues de cualquier salto, sin locks ni estado compartido.
+//
+// Philox4x32 con 10 rondas (Salmon et al., "Parallel random numbers: as easy
+// as 1, 2, 3"): clave = {semilla, efecto}, contador = {bloque, paso, 0, 0}.
+// Cada bloque da 4 numeros de 32 bits; el numero i es la palabra i % 4 del
+// bloque i / 4. azarLlenar calcula 4 bloques a la vez con SSE2.
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AZAR_SSE2 1
+#endif
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_RONDAS 10
+
+typedef struct { uint32_t semilla, paso, efecto; } ClaveAzar;
+
+inline ClaveAzar claveAzar(uint32_t semilla, uint32_t paso, uint32_t efecto) {
+    ClaveAzar c = { semilla, paso, efecto };
+    return c;
+}
+
+// Un bloque: x es el contador a la entrada y los 4 numeros a la salida
+inline void philox4x32(uint32_t x[4], uint32_t k0, uint32_t k1) {
+    for (int r = 0; r < PHILOX_RONDAS; r++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * x[0], p1 = (uint64_t)PHILOX_M1 * x[2];
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ x[1] ^ k0, n2 = (uint32_t)(p0 >> 32) ^ x[3] ^ k1;
+        x[0] = n0; x[1] = (uint32_t)p1; x[2] = n2; x[3] = (uint32_t)p0;
+        k0 += PHILOX_W0; k1 += PHILOX_W1;
+    }
+}
+
+inline void azarBloque(const ClaveAzar& c, uint32_t bloque, uint32_t x[4]) {
+    x[0] = bloque; x[1] = c.paso; x[2] = 0; x[3] = 0;
+    philox4x32(x, c.semilla, c.efecto);
+}
+
+inline uint32_t azarU32(const ClaveAzar& c, uint32_t i) {
+    uint32_t x[4];
+    azarBloque(c, i >> 2, x);
+    return x[i & 3];
+}
+
+// 24 bits en [0, 1): exacto en float
+inline float unidadDeU32(uint32_t u) { return (float)(u >> 8) * (1.0f / 16777216.0f); }
+
+inline float azarUnidad(const ClaveAzar& c, uint32_t i) { return unidadDeU32(azarU32(c, i)); }
+
+#ifdef AZAR_SSE2
+// Parte alta y baja de a * m en los 4 carriles (SSE2 solo multiplica los pares)
+inline void mulAltoBajo(__m128i a, __m128i m, __m128i& alto, __m128i& bajo) {
+    __m128i pares = _mm_mul_epu32(a, m);                          // lo0 hi0 lo2 hi2
+    __m128i impares = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);    // lo1 hi1 lo3 hi3
+    __m128i t0 = _mm_unpacklo_epi32(pares, impares), t1 = _mm_unpackhi_epi32(pares, impares);
+    bajo = _mm_unpacklo_epi64(t0, t1);
+    alto = _mm_unpackhi_epi64(t0, t1);
+}
+
+// Bloques bloque..bloque+3 -> 16 numeros en [0, 1), en orden
+inline void azarUnidad16(const ClaveAzar& c, uint32_t bloque, float* out) {
+    __m128i x0 = _mm_add_epi32(_mm_set1_epi32((int)bloque), _mm_setr_epi32(0, 1, 2, 3));
+    __m128i x1 = _mm_set1_epi32((int)c.paso), x2 = _mm_setzero_si128(), x3 = _mm_setzero_si128();
+    const __m128i m0 = _mm_set1_epi32((int)PHILOX_M0), m1 = _mm_set1_epi32((int)PHILOX_M1);
+    uint32_t k0 = c.semilla, k1 = c.efecto;
+    for (int r = 0; r < PHILOX_RONDAS; r++) {
+        __m128i alto0, bajo0, alto1, bajo1;
+        mulAltoBajo(x0, m0, alto0, bajo0);
+        mulAltoBajo(x2, m1, alto1, bajo1);
+        x0 = _mm_xor_si128(_mm_xor_si128(alto1, x1), _mm_set1_epi32((int)k0));
+        x2 = _mm_xor_si128(_mm_xor_si128(alto0, x3), _mm_set1_epi32((int)k1));
+        x1 = bajo1; x3 = bajo0;
+        k0 += PHILOX_W0; k1 += PHILOX_W1;
+    }
+    const __m128 escala = _mm_set1_ps(1.0f / 16777216.0f);
+    __m128 f0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x0, 8)), escala);
+    __m128 f1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x1, 8)), escala);
+    __m128 f2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x2, 8)), escala);
+    __m128 f3 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x3, 8)), escala);
+    _MM_TRANSPOSE4_PS(f0, f1, f2, f3);    // de palabra por carril a bloque por registro
+    _mm_storeu_ps(out, f0); _mm_storeu_ps(out + 4, f1);
+    _mm_storeu_ps(out + 8, f2); _mm_storeu_ps(out + 12, f3);
+}
+#endif
+
+// out[k] = azarUnidad(c, desde + k) para k en [0, n)
+inline void azarLlenar(const ClaveAzar& c, uint32_t desde, float* out, int n) {
+    int k = 0;
+    for (; k < n && ((desde + k) & 3); k++) out[k] = azarUnidad(c, desde + k);
+#ifdef AZAR_SSE2
+    for (; k + 16 <= n; k += 16) azarUnidad16(c, (desde + k) >> 2, out + k);
+#endif
+    for (; k + 4 <= n; k += 4) {
+        uint32_t x[4];
+        azarBloque(c, (desde + k) >> 2, x);
+        for (int w = 0; w < 4; w++) out[k + w] = unidadDeU32(x[w]);
+    }
+    for (; k < n; k++) out[k] = azarUnidad(c, desde + k);
+}
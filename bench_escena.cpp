@@ -0,0 +1,360 @@
+// bench_escena.cpp - Benchmarks de simulacion y dibujo de la escena (solo CPU)
+//
+// Incluye el programa entero sin su main y mide, con el backend CPU:
+//   update/paso               pasos de update() por segundo (la historia se reinicia al terminar)
+//   dibujar/<ESTADO>          envio de una escena (dibujarEscena) sin rasterizar
+//   frame/<ESTADO>            frame completo: envio + rasterizado
+//   historia/<REUSO>          un paso de update() y su frame, con y sin reusar objetos y tiles
+//   primitiva/dibujarOvalo    throughput de primitivas sueltas (1000 por iteracion)
+//   primitiva/dibujarRect
+//   textura/plumas.jpg        decodificar, generar los mipmaps y subir la textura
+//   particulas/avanzar        un paso de fisica de 100000 chispas (por particula)
+//   azar/llenar               azarLlenar de 65536 numeros (por numero)
+//   guion/pistas              consultar todas las pistas del guion en un instante (por pista)
+//
+// Antes de medir comprueba que recEsperarTodo vuelve cuando lo ultimo que
+// faltaba es una copia por contenido de una imagen ya subida, que una
+// colision de hash no deja pixeles viejos (tiles y objetos) y que las
+// sesiones del servidor conservan su semilla al volver a empezar.
+//
+// Cada benchmark repite su cuerpo duplicando las iteraciones hasta superar
+// --min-tiempo, como Google Benchmark; --json escribe el mismo formato que
+// su --benchmark_out para poder comparar versiones con sus herramientas.
+//
+//   g++ -std=c++14 -O2 -DSIN_GL -pthread bench_escena.cpp -o bench_escena
+//   bench_escena [--filtro texto] [--min-tiempo 0.5] [--hilos N] [--json bench.json]
+#define LEBEDEV_SIN_MAIN
+#include "gpc_project-2d.cpp"
+
+#include <ctime>
+#include <functional>
+#include <future>
+
+typedef struct {
+    std::string nombre;
+    std::function<void()> preparar;          // fuera de la medicion
+    std::function<void(long)> cuerpo;        // corre n iteraciones
+    double itemsPorIteracion;
+} Benchmark;
+
+typedef struct {
+    std::string nombre;
+    long iteraciones;
+    double nsReal, nsCPU, itemsPorSeg;
+} ResultadoBench;
+
+const char* NOMBRES_ESTADO[] = { "INTRO", "DESARROLLO", "DISPAROS", "CIERRE" };
+int pasosBench = 0;      // pasos de la historia en curso en update/paso
+
+// Deja la historia 60 pasos dentro del estado pedido (o en su ultimo paso si dura menos)
+void prepararEstado(EstadoHistoria e) {
+    reiniciarHistoria();
+    int pasos = 0;
+    while (escena.estado != e && pasos < FRAMES_HISTORIA) { update(PASO_MS); pasos++; }
+    for (int i = 0; i < 60; i++) {
+        EstadoEscena antes = escena;
+        update(PASO_MS);
+        if (escena.estado != antes.estado) { escena = antes; break; }
+    }
+}
+
+ResultadoBench correrBenchmark(const Benchmark& b, double minTiempo) {
+    b.preparar();
+    long n = 1;
+    for (;;) {
+        std::clock_t c0 = std::clock();
+        auto t0 = std::chrono::steady_clock::now();
+        b.cuerpo(n);
+        double seg = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double segCPU = (double)(std::clock() - c0) / CLOCKS_PER_SEC;
+        if (seg >= minTiempo || n >= 1000000000L) {
+            ResultadoBench r = { b.nombre, n, seg * 1e9 / n, segCPU * 1e9 / n, b.itemsPorIteracion * n / seg };
+            return r;
+        }
+        // como Google Benchmark: apuntar a 1.4x el minimo, creciendo como mucho 10x
+        double factor = seg > 0.0 ? minTiempo * 1.4 / seg : 10.0;
+        if (factor > 10.0) factor = 10.0;
+        if (factor < 2.0) factor = 2.0;
+        n = (long)(n * factor);
+    }
+}
+
+int guardarJSON(const char* ruta, const char* ejecutable, const std::vector<ResultadoBench>& res) {
+    FILE* f = fopen(ruta, "w");
+    if (!f) return 0;
+    char fecha[64];
+    time_t ahora = time(NULL);
+    strftime(fecha, sizeof(fecha), "%Y-%m-%dT%H:%M:%S", localtime(&ahora));
+    fprintf(f, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"%s\",\n"
+               "    \"num_cpus\": %u,\n    \"hilos_raster\": %d,\n    \"library_build_type\": \"release\"\n  },\n"
+               "  \"benchmarks\": [\n", fecha, ejecutable, std::thread::hardware_concurrency(), poolNumHilos(poolRaster));
+    for (size_t i = 0; i < res.size(); i++) {
+        const ResultadoBench& r = res[i];
+        fprintf(f, "    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n"
+                   "      \"iterations\": %ld,\n      \"real_time\": %.4f,\n      \"cpu_time\": %.4f,\n"
+                   "      \"time_unit\": \"ns\",\n      \"items_per_second\": %.4f\n    }%s\n",
+                r.nombre.c_str(), r.nombre.c_str(), r.iteraciones, r.nsReal, r.nsCPU, r.itemsPorSeg,
+                i + 1 < res.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    int ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Pide plumas.jpg con dos rutas (mismos bytes), la segunda cuando la primera
+// ya esta lista, y espera con recEsperarTodo mientras la copia se hashea. Las
+// dos tienen que terminar con la misma textura; si la espera no vuelve en 5 s
+// el gestor no se desperto.
+int comprobarDuplicados() {
+    const char* rutas[2] = { "bench_duplicado_1.jpg", "bench_duplicado_2.jpg" };
+    std::vector<unsigned char> bytes;
+    if (!leerArchivo("plumas.jpg", bytes)) return 1;
+    bytes.resize(bytes.size() + (8 << 20), 0);   // relleno tras el fin del JPEG: hashear la copia tarda
+    for (const char* ruta : rutas) {
+        FILE* f = fopen(ruta, "wb");
+        if (!f) { printf(">> ERROR: no se pudo escribir %s\n", ruta); return 0; }
+        fwrite(bytes.data(), 1, bytes.size(), f);
+        fclose(f);
+    }
+    GestorRecursos g;
+    recUsarAtlas(g, TAM_MAX_ATLAS);
+    recIniciar(g, 1);
+    std::packaged_task<int()> tarea([&g, &rutas] {
+        int a = recPedirImagen(g, rutas[0], COL_PLUMAS_RESPALDO);
+        recEsperarTodo(g);
+        int b = recPedirImagen(g, rutas[1], COL_PLUMAS_RESPALDO);
+        recEsperarTodo(g);
+        return (int)(recTextura(g, a) != 0 && recTextura(g, a) == recTextura(g, b));
+    });
+    std::future<int> resultado = tarea.get_future();
+    std::thread hilo(std::move(tarea));
+    int ok = resultado.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    for (const char* ruta : rutas) remove(ruta);
+    if (!ok) {
+        printf(">> ERROR: recEsperarTodo no volvio con una copia por contenido pendiente\n");
+        fflush(stdout);
+        _Exit(-1);                    // el hilo sigue esperando: no se puede ni unir ni destruir g
+    }
+    hilo.join();
+    recDetener(g);
+    if (!resultado.get()) { printf(">> ERROR: las copias por contenido no comparten la textura\n"); return 0; }
+    printf(">> Recursos duplicados: ok\n");
+    return 1;
+}
+
+// Dos sesiones del servidor iguales salvo la semilla arrancan al final de la
+// historia y la recorren de nuevo a 16 pasos por tick. Despues de volver a
+// empezar cada una tiene que seguir con su semilla: en algun tick los
+// fogonazos y las particulas dan frames distintos.
+int comprobarSemillasServidor() {
+    Sesion s[2];
+    for (int i = 0; i < 2; i++) {
+        s[i].estado = estadoEnPaso(FRAMES_HISTORIA - 1);
+        s[i].estado.semilla = (uint32_t)i + 1;
+        s[i].paleta = PALETAS_SERVIDOR[0];
+        s[i].velocidad = 16.0f;
+        s[i].pasosPendientes = 0.0f;
+        s[i].hashFrame = 0;
+    }
+    int distintos = 0;
+    for (int tick = 0; tick * 16 < FRAMES_HISTORIA; tick++) {
+        for (int i = 0; i < 2; i++) atenderSesion(s[i], NULL);
+        if (s[0].estado.timerGlobal != s[1].estado.timerGlobal) break;
+        distintos += s[0].hashFrame != s[1].hashFrame;
+    }
+    if (s[0].estado.semilla != 1 || s[1].estado.semilla != 2 || !distintos) {
+        printf(">> ERROR: las sesiones del servidor pierden su semilla al volver a empezar\n");
+        return 0;
+    }
+    printf(">> Semillas del servidor: ok (%d frames distintos)\n", distintos);
+    return 1;
+}
+
+// Reuso con colisiones de hash forzadas: dos frames con distinto color y el
+// mismo resumen, primero en los tiles (todas las primitivas con el mismo hash)
+// y despues en un objeto grabado (el hash del frame anterior con otros
+// comandos). En los dos casos el segundo frame tiene que dibujarse de nuevo.
+int comprobarColisiones() {
+    float fondo[3] = {0, 0, 0};
+    float cols[2][4] = {{1, 0, 0, 1}, {0, 1, 0, 1}};
+    uint32_t tile[2];
+    RasterizadorCPU rc;
+    rcCrear(rc, 128, 128, NULL);
+    for (int f = 0; f < 2; f++) {
+        rcIniciarFrame(rc, fondo);
+        VerticeRaster a = {10, 10, 0.5f, 0, 0}, b = {100, 10, 0.5f, 0, 0}, c = {10, 100, 0.5f, 0, 0};
+        rcTriangulo(rc, a, b, c, cols[f], NULL);
+        for (PrimRaster& p : rc.prims) p.hash = 42;
+        rcFlush(rc);
+        tile[f] = rc.fb.color[20 * 128 + 20];
+    }
+
+    const int id = OBJ_PARTICULAS + 1;   // fuera de los de la escena
+    const float* colores[2] = { COL_ROJO, COL_VERDE_GRIS };
+    uint32_t objeto[2];
+    uint64_t hash = 0;
+    int reuso = reusoDibujo;
+    reusoDibujo = 1;
+    for (int f = 0; f < 2; f++) {
+        rIniciarFrame(COL_FONDO);
+        rComenzarObjeto(id);
+        colorRGB(colores[f]); rRectf(10, 10, 90, 90);
+        if (f == 0) { rTerminarObjeto(); hash = objetosCPU[id].hash; }
+        else {                               // rTerminarObjeto a mano, con el hash del frame anterior
+            objetoEnCurso = -1;
+            float sesgo = sesgoOrden(ordenBaseObjeto);
+            ordenEnvio += ordenBaseObjeto;
+            if (!backendActual->repetirObjeto(id, hash, comandosObjeto.data(), comandosObjeto.size(), sesgo)) {
+                backendActual->comenzarObjeto(id, sesgo);
+                reproducirComandos(backendActual, comandosObjeto.data(), comandosObjeto.data() + comandosObjeto.size());
+                backendActual->terminarObjeto(id, hash, comandosObjeto.data(), comandosObjeto.size());
+            }
+        }
+        rTerminarFrame();
+        objeto[f] = rasterCPU.fb.color[(size_t)(rasterCPU.fb.alto / 2) * rasterCPU.fb.ancho + rasterCPU.fb.ancho / 2];
+    }
+    reusoDibujo = reuso;
+    if (tile[0] == tile[1]) { printf(">> ERROR: un tile con el hash del frame anterior no se volvio a dibujar\n"); return 0; }
+    if (objeto[0] == objeto[1]) { printf(">> ERROR: un objeto con el hash del frame anterior se repitio\n"); return 0; }
+    printf(">> Colisiones de hash: ok\n");
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    const char* filtro = NULL;
+    const char* json = NULL;
+    double minTiempo = 0.5;
+    int hilos = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filtro") == 0 && i + 1 < argc) filtro = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) json = argv[++i];
+        else if (strcmp(argv[i], "--min-tiempo") == 0 && i + 1 < argc) minTiempo = atof(argv[++i]);
+        else if (strcmp(argv[i], "--hilos") == 0 && i + 1 < argc) hilos = atoi(argv[++i]);
+        else {
+            printf("Uso: %s [--filtro texto] [--min-tiempo seg] [--hilos N] [--json bench.json]\n", argv[0]);
+            return -1;
+        }
+    }
+    iniciarGuion(NULL);
+
+    backendCPUIniciar(SCR_WIDTH, SCR_HEIGHT, hilos, 0);
+    backendActual = &backendCPU;
+    cargarTexturas();
+    construirMallas();
+    construirRigs();
+
+    if (!comprobarColisiones() || !comprobarSemillasServidor()) { poolDetener(poolRaster); return -1; }
+
+    std::vector<Benchmark> benchs;
+    benchs.push_back({ "update/paso", [] { reiniciarHistoria(); pasosBench = 0; }, [](long n) {
+        for (long i = 0; i < n; i++) {
+            if (pasosBench == FRAMES_HISTORIA) { reiniciarHistoria(); pasosBench = 0; }
+            update(PASO_MS);
+            pasosBench++;
+        }
+    }, 1.0 });
+    for (int e = INTRO; e <= CIERRE; e++) {
+        EstadoHistoria estado = (EstadoHistoria)e;
+        benchs.push_back({ std::string("dibujar/") + NOMBRES_ESTADO[e], [estado] { reusoDibujo = 0; prepararEstado(estado); }, [](long n) {
+            for (long i = 0; i < n; i++) { rIniciarFrame(COL_FONDO); dibujarEscena(escena); }
+        }, 1.0 });
+    }
+    for (int e = INTRO; e <= CIERRE; e++) {
+        EstadoHistoria estado = (EstadoHistoria)e;
+        benchs.push_back({ std::string("frame/") + NOMBRES_ESTADO[e], [estado] { reusoDibujo = 0; prepararEstado(estado); }, [](long n) {
+            for (long i = 0; i < n; i++) { rIniciarFrame(COL_FONDO); dibujarEscena(escena); rTerminarFrame(); }
+        }, 1.0 });
+    }
+    // La historia avanzando: un frame quieto no cuenta, todo se repetiria
+    for (int reuso = 0; reuso <= 1; reuso++) {
+        benchs.push_back({ reuso ? "historia/con-reuso" : "historia/sin-reuso", [reuso] {
+            reusoDibujo = reuso; reiniciarHistoria(); pasosBench = 0;
+        }, [](long n) {
+            for (long i = 0; i < n; i++) {
+                if (pasosBench == FRAMES_HISTORIA) { reiniciarHistoria(); pasosBench = 0; }
+                update(PASO_MS);
+                pasosBench++;
+                rIniciarFrame(COL_FONDO); dibujarEscena(escena); rTerminarFrame();
+            }
+        }, 1.0 });
+    }
+    // 1000 piezas repartidas en una grilla de 40x25 sobre la pantalla
+    benchs.push_back({ "primitiva/dibujarOvalo", [] {}, [](long n) {
+        for (long i = 0; i < n; i++) {
+            rIniciarFrame(COL_FONDO);
+            for (int k = 0; k < 1000; k++) {
+                rPushMatrix(); rTranslatef(1.25f + (k % 40) * 2.5f, 2.0f + (k / 40) * 4.0f, 0.0f);
+                dibujarOvalo(1.2f, 1.8f, COL_ROJO);
+                rPopMatrix();
+            }
+        }
+    }, 1000.0 });
+    benchs.push_back({ "primitiva/dibujarRect", [] {}, [](long n) {
+        for (long i = 0; i < n; i++) {
+            rIniciarFrame(COL_FONDO);
+            for (int k = 0; k < 1000; k++) {
+                rPushMatrix(); rTranslatef(1.25f + (k % 40) * 2.5f, 2.0f + (k / 40) * 4.0f, 0.0f);
+                dibujarRect(2.0f, 3.0f, COL_CAQUI);
+                rPopMatrix();
+            }
+        }
+    }, 1000.0 });
+    // Chispas que no mueren, rebotando en el suelo: siempre las mismas 100000
+    static PoolParticulas chispasBench;
+    benchs.push_back({ "particulas/avanzar", [] {
+        partIniciar(chispasBench, 100000, FISICA_PARTICULAS[PART_CHISPA]);
+        for (int i = 0; i < chispasBench.capacidad; i++)
+            partEmitir(chispasBench, (i % 1000) * 0.1f, 20.0f + (i / 1000) * 0.5f, 30.0f, 10.0f, 1e9f, 0.0f, 1.0f, 1.0f);
+    }, [](long n) {
+        for (long i = 0; i < n; i++) partAvanzar(chispasBench, PASO_MS / 1000.0f, NULL);
+    }, 100000.0 });
+    static std::vector<float> azarBench(65536);
+    benchs.push_back({ "azar/llenar", [] {}, [](long n) {
+        for (long i = 0; i < n; i++) azarLlenar(claveAzar(1, (uint32_t)i, AZAR_FUENTES), 0, azarBench.data(), (int)azarBench.size());
+    }, 65536.0 });
+    benchs.push_back({ "guion/pistas", [] {}, [](long n) {
+        float suma = 0.0f;
+        for (long i = 0; i < n; i++) {
+            float t = (float)((i * 7919) % 25000);
+            for (int id = 0; id < PISTAS_HISTORIA; id++)
+                suma += TIPOS_PISTA[id] == PISTA_VALOR ? guionValor(guion, id, t) : (float)guionAntes(guion, id, t);
+        }
+        volatile float sumidero = suma; (void)sumidero;
+    }, (double)PISTAS_HISTORIA });
+    FILE* textura = fopen("plumas.jpg", "rb");
+    if (textura) {
+        fclose(textura);
+        if (!comprobarDuplicados()) { poolDetener(poolRaster); return -1; }
+        benchs.push_back({ "textura/plumas.jpg", [] {}, [](long n) {
+            for (long i = 0; i < n; i++) {
+                int ancho, alto, canales;
+                stbi_set_flip_vertically_on_load(1);
+                unsigned char* datos = stbi_load("plumas.jpg", &ancho, &alto, &canales, 0);
+                if (!datos) continue;
+                rLiberarTextura(rCrearTextura(datos, ancho, alto, canales));   // no acumular copias
+                stbi_image_free(datos);
+            }
+        }, 1.0 });
+    } else {
+        printf(">> plumas.jpg no esta en el directorio actual: se omite textura/plumas.jpg\n");
+    }
+
+    printf("%-28s %14s %14s %12s %16s\n", "Benchmark", "Tiempo", "CPU", "Iteraciones", "items/s");
+    printf("------------------------------------------------------------------------------------------\n");
+    std::vector<ResultadoBench> resultados;
+    for (const Benchmark& b : benchs) {
+        if (filtro && b.nombre.find(filtro) == std::string::npos) continue;
+        ResultadoBench r = correrBenchmark(b, minTiempo);
+        printf("%-28s %11.0f ns %11.0f ns %12ld %16.1f\n", r.nombre.c_str(), r.nsReal, r.nsCPU, r.iteraciones, r.itemsPorSeg);
+        resultados.push_back(r);
+    }
+
+    int res = 0;
+    if (json) {
+        if (guardarJSON(json, argv[0], resultados)) printf(">> Resultados guardados en %s\n", json);
+        else { printf(">> ERROR: no se pudo escribir %s\n", json); res = -1; }
+    }
+    poolDetener(poolRaster);
+    return res;
+}
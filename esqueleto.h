@@ -0,0 +1,100 @@
+// esqueleto.h - Jerarquias de huesos para los personajes
+//
+// Un rig es una lista de huesos y una lista de piezas pegadas a ellos. Cada
+// hueso guarda su transformacion local (traslacion, luego rotacion, luego
+// escala, el mismo orden en que la escena llamaba a rTranslatef/rRotatef/
+// rScalef) y el indice de su padre, que siempre es menor que el suyo: asi una
+// sola pasada en orden deja calculadas todas las matrices de mundo.
+//
+// Las piezas se dibujan agrupadas por color (material) con rDibujarLote; cada
+// una conserva su orden de envio original para que la imagen no cambie.
+// Incluir despues de render.h.
+#pragma once
+
+#include <math.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RIG_SSE2 1
+#endif
+
+#define MALLA_OVALO -1     // pieza ovalada: la malla se elige por tamano en pantalla
+
+typedef struct {
+    int hueso;
+    int malla;              // id de malla o MALLA_OVALO
+    float sx, sy;           // escala propia de la pieza (no la heredan los hijos)
+    const float* color;     // material: las piezas con el mismo color van en un lote
+    unsigned condicion;     // bits que deben estar activos para dibujarla (0 = siempre)
+} PiezaRig;
+
+struct Rig {
+    // Huesos (SoA). Los angulos van en grados, como en rRotatef
+    std::vector<float> x, y, z, rot, sx, sy;
+    std::vector<int> padre;              // -1 = cuelga de la matriz con la que se evalua
+    std::vector<Matriz2D> mundo;         // resultado de rigEvaluar
+    std::vector<PiezaRig> piezas;        // en el orden original de dibujo
+    std::vector<int> porMaterial;        // indices de piezas agrupados por color
+};
+
+inline int rigHueso(Rig& r, int padre, float x, float y, float z, float rot) {
+    r.x.push_back(x); r.y.push_back(y); r.z.push_back(z); r.rot.push_back(rot);
+    r.sx.push_back(1.0f); r.sy.push_back(1.0f);
+    r.padre.push_back(padre);
+    r.mundo.push_back(Matriz2D());
+    return (int)r.padre.size() - 1;
+}
+
+inline void rigPieza(Rig& r, int hueso, int malla, float sx, float sy, const float* color, unsigned condicion) {
+    PiezaRig p = { hueso, malla, sx, sy, color, condicion };
+    r.piezas.push_back(p);
+}
+
+// Se llama una vez al terminar de agregar piezas: deja armados los grupos
+// por material, en el orden en que aparece cada color por primera vez
+inline void rigAgruparPorMaterial(Rig& r) {
+    r.porMaterial.clear();
+    std::vector<char> usada(r.piezas.size(), 0);
+    for (size_t i = 0; i < r.piezas.size(); i++) {
+        if (usada[i]) continue;
+        for (size_t j = i; j < r.piezas.size(); j++) {
+            if (!usada[j] && r.piezas[j].color == r.piezas[i].color) { usada[j] = 1; r.porMaterial.push_back((int)j); }
+        }
+    }
+}
+
+// padre * traslacion(x, y, z) * rotacion(c, s) * escala(sx, sy). Las dos
+// columnas lineales (a,b) y (c,d) van juntas en un registro de 4 floats.
+// Da exactamente los mismos valores que la pila de render.h.
+inline Matriz2D componerHueso(const Matriz2D& p, float x, float y, float z, float c, float s, float sx, float sy) {
+    Matriz2D m;
+#ifdef RIG_SSE2
+    __m128 lin = _mm_loadu_ps(&p.a);                                  // a b c d
+    __m128 ab = _mm_shuffle_ps(lin, lin, _MM_SHUFFLE(1, 0, 1, 0));    // a b a b
+    __m128 cd = _mm_shuffle_ps(lin, lin, _MM_SHUFFLE(3, 2, 3, 2));    // c d c d
+    __m128 t = _mm_add_ps(_mm_mul_ps(ab, _mm_set1_ps(x)), _mm_mul_ps(cd, _mm_set1_ps(y)));
+    t = _mm_add_ps(_mm_setr_ps(p.tx, p.ty, 0.0f, 0.0f), t);
+    __m128 r = _mm_add_ps(_mm_mul_ps(ab, _mm_setr_ps(c, c, -s, -s)), _mm_mul_ps(cd, _mm_setr_ps(s, s, c, c)));
+    r = _mm_mul_ps(r, _mm_setr_ps(sx, sx, sy, sy));
+    _mm_storeu_ps(&m.a, r);
+    float tt[4];
+    _mm_storeu_ps(tt, t);
+    m.tx = tt[0]; m.ty = tt[1];
+#else
+    m.tx = p.tx + (p.a * x + p.c * y); m.ty = p.ty + (p.b * x + p.d * y);
+    m.a = (p.a * c + p.c * s) * sx; m.b = (p.b * c + p.d * s) * sx;
+    m.c = (p.c * c - p.a * s) * sy; m.d = (p.d * c - p.b * s) * sy;
+#endif
+    m.tz = p.tz + z;
+    return m;
+}
+
+inline void rigEvaluar(Rig& r, const Matriz2D& raiz) {
+    int n = (int)r.padre.size();
+    for (int i = 0; i < n; i++) {
+        const Matriz2D& p = r.padre[i] < 0 ? raiz : r.mundo[r.padre[i]];
+        float rad = r.rot[i] * 3.14159265f / 180.0f;
+        r.mundo[i] = componerHueso(p, r.x[i], r.y[i], r.z[i], cosf(rad), sinf(rad), r.sx[i], r.sy[i]);
+    }
+}
@@ -0,0 +1,235 @@
+// exportar.h - Escritura de frames a disco en un hilo aparte
+//
+// El render entrega frames RGBA8 (fila 0 = abajo, como glReadPixels) y un
+// hilo escritor los convierte y guarda, asi la codificacion nunca frena el
+// render. Los buffers se reciclan entre ambos lados: si el escritor va
+// atrasado, expPedirBuffer espera (contrapresion) en vez de acumular memoria.
+//
+// Formatos segun la ruta de salida:
+//   *.y4m          -> un solo stream YUV4MPEG2 4:2:0 (C420jpeg, rango completo)
+//   ruta con %d    -> secuencia PNG numerada (p.ej. frames/f%05d.png)
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "perfil.h"
+
+typedef enum { EXP_Y4M, EXP_PNG } FormatoExport;
+
+struct Exportador {
+    FormatoExport formato = EXP_Y4M;
+    const char* ruta = nullptr;
+    int ancho = 0, alto = 0;
+    int fpsNum = 0, fpsDen = 1;
+    FILE* stream = nullptr;                   // solo Y4M
+    std::vector<std::vector<uint32_t>> buffers;
+    std::deque<int> cola;                     // frames listos para escribir, en orden
+    std::vector<int> libres;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread hilo;
+    bool cerrando = false;
+    bool error = false;
+    int escritos = 0;
+    std::vector<unsigned char> temp, temp2;   // conversion, solo los usa el escritor
+};
+
+// --- PNG ---
+// Sin dependencias: bloques deflate sin comprimir ("stored"). Los archivos
+// salen grandes pero escribirlos cuesta poco mas que un memcpy.
+
+inline uint32_t crc32Png(uint32_t crc, const unsigned char* p, size_t n) {
+    struct Tabla {
+        uint32_t v[256];
+        Tabla() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                v[i] = c;
+            }
+        }
+    };
+    static const Tabla tabla;
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = tabla.v[(crc ^ p[i]) & 255] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline void pngBloque(FILE* f, const char tipo[4], const unsigned char* datos, size_t n) {
+    unsigned char cab[8] = { (unsigned char)(n >> 24), (unsigned char)(n >> 16), (unsigned char)(n >> 8), (unsigned char)n,
+                             (unsigned char)tipo[0], (unsigned char)tipo[1], (unsigned char)tipo[2], (unsigned char)tipo[3] };
+    fwrite(cab, 1, 8, f);
+    if (n) fwrite(datos, 1, n, f);
+    uint32_t crc = crc32Png(crc32Png(0, cab + 4, 4), datos, n);
+    unsigned char c[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+    fwrite(c, 1, 4, f);
+}
+
+inline uint32_t adler32(const unsigned char* p, size_t n) {
+    uint32_t s1 = 1, s2 = 0;
+    while (n > 0) {
+        size_t bloque = n < 5552 ? n : 5552;   // maximo sin desbordar antes del modulo
+        n -= bloque;
+        while (bloque--) { s1 += *p++; s2 += s1; }
+        s1 %= 65521; s2 %= 65521;
+    }
+    return (s2 << 16) | s1;
+}
+
+// RGBA8 con la fila 0 abajo -> PNG RGB con la fila de arriba primero
+inline int escribirPNG(const char* ruta, const uint32_t* rgba, int ancho, int alto,
+                       std::vector<unsigned char>& crudo, std::vector<unsigned char>& comprimido) {
+    size_t bytesFila = (size_t)ancho * 3 + 1;
+    crudo.resize(bytesFila * alto);
+    for (int y = 0; y < alto; y++) {
+        unsigned char* d = &crudo[bytesFila * y];
+        const uint32_t* src = rgba + (size_t)(alto - 1 - y) * ancho;
+        *d++ = 0;                             // filtro "None"
+        for (int x = 0; x < ancho; x++) { *d++ = src[x] & 255; *d++ = (src[x] >> 8) & 255; *d++ = (src[x] >> 16) & 255; }
+    }
+
+    size_t numBloques = (crudo.size() + 65534) / 65535;
+    comprimido.resize(2 + crudo.size() + numBloques * 5 + 4);
+    unsigned char* z = comprimido.data();
+    *z++ = 0x78; *z++ = 0x01;                 // cabecera zlib
+    for (size_t pos = 0; pos < crudo.size(); ) {
+        size_t n = crudo.size() - pos > 65535 ? 65535 : crudo.size() - pos;
+        *z++ = (pos + n == crudo.size()) ? 1 : 0;
+        *z++ = n & 255; *z++ = (n >> 8) & 255; *z++ = ~n & 255; *z++ = (~n >> 8) & 255;
+        memcpy(z, &crudo[pos], n);
+        z += n; pos += n;
+    }
+    uint32_t adler = adler32(crudo.data(), crudo.size());
+    *z++ = adler >> 24; *z++ = (adler >> 16) & 255; *z++ = (adler >> 8) & 255; *z++ = adler & 255;
+
+    FILE* f = fopen(ruta, "wb");
+    if (!f) return 0;
+    static const unsigned char firma[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(firma, 1, 8, f);
+    unsigned char ihdr[13] = { (unsigned char)(ancho >> 24), (unsigned char)(ancho >> 16), (unsigned char)(ancho >> 8), (unsigned char)ancho,
+                               (unsigned char)(alto >> 24), (unsigned char)(alto >> 16), (unsigned char)(alto >> 8), (unsigned char)alto,
+                               8, 2, 0, 0, 0 };
+    pngBloque(f, "IHDR", ihdr, 13);
+    pngBloque(f, "IDAT", comprimido.data(), (size_t)(z - comprimido.data()));
+    pngBloque(f, "IEND", nullptr, 0);
+    int ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// --- Y4M ---
+
+// RGBA8 (fila 0 abajo) -> planos Y, Cb, Cr 4:2:0 con BT.601 de rango completo
+inline void rgbaAYuv420(const uint32_t* rgba, int ancho, int alto, unsigned char* yuv) {
+    unsigned char* planoY = yuv;
+    unsigned char* planoU = yuv + (size_t)ancho * alto;
+    unsigned char* planoV = planoU + (size_t)(ancho / 2) * (alto / 2);
+    for (int y = 0; y < alto; y++) {
+        const uint32_t* fila = rgba + (size_t)(alto - 1 - y) * ancho;
+        for (int x = 0; x < ancho; x++) {
+            int r = fila[x] & 255, g = (fila[x] >> 8) & 255, b = (fila[x] >> 16) & 255;
+            planoY[(size_t)y * ancho + x] = (unsigned char)((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+        }
+    }
+    for (int y = 0; y < alto / 2; y++) {
+        const uint32_t* f0 = rgba + (size_t)(alto - 1 - 2 * y) * ancho;
+        const uint32_t* f1 = f0 - ancho;
+        for (int x = 0; x < ancho / 2; x++) {
+            int r = 0, g = 0, b = 0;
+            const uint32_t px[4] = { f0[2 * x], f0[2 * x + 1], f1[2 * x], f1[2 * x + 1] };
+            for (int k = 0; k < 4; k++) { r += px[k] & 255; g += (px[k] >> 8) & 255; b += (px[k] >> 16) & 255; }
+            int u = (-11059 * r - 21709 * g + 32768 * b + 4 * 8388608 + 131072) >> 18;
+            int v = (32768 * r - 27439 * g - 5329 * b + 4 * 8388608 + 131072) >> 18;
+            planoU[(size_t)y * (ancho / 2) + x] = (unsigned char)(u < 0 ? 0 : u > 255 ? 255 : u);
+            planoV[(size_t)y * (ancho / 2) + x] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+    }
+}
+
+// --- HILO ESCRITOR ---
+
+inline int expEscribirFrame(Exportador& e, const std::vector<uint32_t>& frame) {
+    ZONA_PERFIL("expEscribirFrame");
+    if (e.formato == EXP_PNG) {
+        char ruta[1024];
+        snprintf(ruta, sizeof(ruta), e.ruta, e.escritos);
+        return escribirPNG(ruta, frame.data(), e.ancho, e.alto, e.temp, e.temp2);
+    }
+    e.temp.resize((size_t)e.ancho * e.alto * 3 / 2);
+    rgbaAYuv420(frame.data(), e.ancho, e.alto, e.temp.data());
+    fputs("FRAME\n", e.stream);
+    return fwrite(e.temp.data(), 1, e.temp.size(), e.stream) == e.temp.size();
+}
+
+inline void expBucleEscritor(Exportador* e) {
+    for (;;) {
+        int idx;
+        {
+            std::unique_lock<std::mutex> lock(e->mtx);
+            e->cv.wait(lock, [&] { return !e->cola.empty() || e->cerrando; });
+            if (e->cola.empty()) return;
+            idx = e->cola.front();
+            e->cola.pop_front();
+        }
+        int ok = expEscribirFrame(*e, e->buffers[idx]);
+        std::lock_guard<std::mutex> lock(e->mtx);
+        if (!ok) e->error = true;
+        e->escritos++;
+        e->libres.push_back(idx);
+        e->cv.notify_all();
+    }
+}
+
+// fps = fpsNum / fpsDen. Devuelve 0 si la ruta no es valida o no se puede abrir
+inline int expAbrir(Exportador& e, const char* ruta, int ancho, int alto, int fpsNum, int fpsDen, int numBuffers) {
+    size_t largo = strlen(ruta);
+    if (strchr(ruta, '%')) e.formato = EXP_PNG;
+    else if (largo > 4 && strcmp(ruta + largo - 4, ".y4m") == 0) e.formato = EXP_Y4M;
+    else { printf(">> ERROR: formato de exportacion desconocido (usar .y4m o un patron PNG con %%d): %s\n", ruta); return 0; }
+    if (e.formato == EXP_Y4M && (ancho % 2 || alto % 2)) { printf(">> ERROR: Y4M 4:2:0 necesita ancho y alto pares\n"); return 0; }
+
+    e.ruta = ruta; e.ancho = ancho; e.alto = alto; e.fpsNum = fpsNum; e.fpsDen = fpsDen;
+    if (e.formato == EXP_Y4M) {
+        e.stream = fopen(ruta, "wb");
+        if (!e.stream) { printf(">> ERROR: no se pudo crear %s\n", ruta); return 0; }
+        fprintf(e.stream, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", ancho, alto, fpsNum, fpsDen);
+    }
+    e.buffers.assign(numBuffers, std::vector<uint32_t>((size_t)ancho * alto));
+    for (int i = 0; i < numBuffers; i++) e.libres.push_back(i);
+    e.hilo = std::thread(expBucleEscritor, &e);
+    return 1;
+}
+
+// Devuelve el indice de un buffer libre para llenar; espera si estan todos en cola
+inline int expPedirBuffer(Exportador& e) {
+    std::unique_lock<std::mutex> lock(e.mtx);
+    e.cv.wait(lock, [&] { return !e.libres.empty(); });
+    int idx = e.libres.back();
+    e.libres.pop_back();
+    return idx;
+}
+
+inline void expEnviar(Exportador& e, int idx) {
+    std::lock_guard<std::mutex> lock(e.mtx);
+    e.cola.push_back(idx);
+    e.cv.notify_all();
+}
+
+// Espera a que se escriba todo lo encolado. Devuelve 0 si hubo algun error
+inline int expCerrar(Exportador& e) {
+    {
+        std::lock_guard<std::mutex> lock(e.mtx);
+        e.cerrando = true;
+    }
+    e.cv.notify_all();
+    if (e.hilo.joinable()) e.hilo.join();
+    if (e.stream) { if (fclose(e.stream) != 0) e.error = true; e.stream = nullptr; }
+    return !e.error;
+}
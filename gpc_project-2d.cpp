@@ -1,11 +1,36 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// Compilar con -DSIN_GL deja solo el modo headless: no hace falta GLFW, GLAD
+// ni libGL (nodos de render sin GPU ni servidor grafico)
+#ifndef SIN_GL
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #include <stdio.h>
 #include <stdlib.h> 
+#include <string.h>
 #include <math.h>
+#include <stddef.h>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+
+#include "perfil.h"
+#include "render.h"
+#include "recursos.h"
+#include "exportar.h"
+#include "esqueleto.h"
+#include "particulas.h"
+#include "azar.h"
+#include "guion.h"
+#include "vigilancia.h"
+
+// Todo el azar sale de azar.h, por paso: la exportacion en paralelo y los
+// saltos dan los mismos frames solo si nadie usa el estado global de rand()
+#ifdef __GNUC__
+#pragma GCC poison rand srand
+#endif
 
 // --- CONSTANTES DE PANTALLA ---
 const unsigned int SCR_WIDTH = 800;
@@ -14,343 +39,2109 @@ const unsigned int SCR_HEIGHT = 600;
 // --- DEFINICIONES DE LÓGICA ---
 #define PI 3.14159265
 
-// PALETA DE COLORES
-const float COL_FONDO[3] = {0.85f, 0.82f, 0.75f}; 
-const float COL_ROJO[3] = {0.8f, 0.25f, 0.15f};   
-const float COL_CAQUI[3] = {0.55f, 0.4f, 0.25f};  
-const float COL_OSCURO[3] = {0.15f, 0.15f, 0.15f}; 
-const float COL_VERDE_GRIS[3] = {0.3f, 0.35f, 0.3f}; 
-const float COL_BLANCO[3] = {1.0f, 1.0f, 1.0f};    
-const float COL_MADERA[3] = {0.45f, 0.3f, 0.2f};   
-const float COL_METAL[3] = {0.25f, 0.25f, 0.25f};  
-const float COL_FUEGO_INT[3] = {1.0f, 1.0f, 0.0f}; 
-const float COL_FUEGO_EXT[3] = {1.0f, 0.5f, 0.0f}; 
+// PALETA DE COLORES (modificable: las piezas apuntan a estos arreglos y
+// --ajustes / --vigilar les cambian el valor)
+float COL_FONDO[3] = {0.85f, 0.82f, 0.75f}; 
+float COL_ROJO[3] = {0.8f, 0.25f, 0.15f};   
+float COL_CAQUI[3] = {0.55f, 0.4f, 0.25f};  
+float COL_OSCURO[3] = {0.15f, 0.15f, 0.15f}; 
+float COL_VERDE_GRIS[3] = {0.3f, 0.35f, 0.3f}; 
+float COL_BLANCO[3] = {1.0f, 1.0f, 1.0f};    
+float COL_MADERA[3] = {0.45f, 0.3f, 0.2f};   
+float COL_METAL[3] = {0.25f, 0.25f, 0.25f};  
+float COL_FUEGO_INT[3] = {1.0f, 1.0f, 0.0f}; 
+float COL_FUEGO_EXT[3] = {1.0f, 0.5f, 0.0f}; 
+float COL_TRAZADORA[3] = {1.0f, 1.0f, 0.8f};
+float COL_HUMO[3] = {0.55f, 0.53f, 0.5f};
+float COL_LATON[3] = {0.8f, 0.62f, 0.25f};
+
+float* const PALETA[] = { COL_FONDO, COL_ROJO, COL_CAQUI, COL_OSCURO, COL_VERDE_GRIS, COL_BLANCO, COL_MADERA,
+                          COL_METAL, COL_FUEGO_INT, COL_FUEGO_EXT, COL_TRAZADORA, COL_HUMO, COL_LATON };
+const char* const NOMBRES_COLOR[] = { "COL_FONDO", "COL_ROJO", "COL_CAQUI", "COL_OSCURO", "COL_VERDE_GRIS", "COL_BLANCO",
+                                      "COL_MADERA", "COL_METAL", "COL_FUEGO_INT", "COL_FUEGO_EXT", "COL_TRAZADORA",
+                                      "COL_HUMO", "COL_LATON" };
+const int COLORES_PALETA = sizeof(PALETA) / sizeof(PALETA[0]);
 
 // ESTADOS
 typedef enum { INTRO, DESARROLLO, DISPAROS, CIERRE } EstadoHistoria;
-EstadoHistoria estadoActual = INTRO;
-
 typedef enum { FIN_ESPERA_PALOMA, FIN_MIRAR, FIN_SOLTAR, FIN_ABRAZO } SubEstadoFin;
-SubEstadoFin subEstadoActual = FIN_ESPERA_PALOMA;
-
-// VARIABLES DE TIEMPO Y ESTADO
-double lastTime = 0.0;
-int timerFinal = 0; 
-int timerGlobal = 0;
-int timerDisparos = 0;
-int contadorDisparos = 0;
-int esFogonazo = 0;
-
-// TEXTURAS
-GLuint texturaPlumas = 0;
-
-// Animación
-float posPalomaX = 10.0f, posPalomaY = 40.0f;
-float dirPalomaX = 1.0f, dirPalomaY = 0.5f;
-int numPisadasTotal = 0; 
-
-float posSolIzqX = -15.0f;
-float posSolDerX = -35.0f;
-int tieneCasco = 0, tieneArmaIzq = 0, tieneArmaDer = 0;
-
-const float POS_CASCO = 35.0f;
-const float POS_ARMA_IZQ = 55.0f;
-const float POS_ARMA_DER = 75.0f;
-float anguloBrazo = 0.0f;
-float anguloPierna = 0.0f;
+
+// La simulacion avanza siempre en pasos fijos de PASO_MS: el resultado de
+// avanzarEscena() depende solo del numero de pasos, nunca del ritmo de render
+const int PASO_MS = 16;
+
+// AJUSTES: lo que un artista retoca sin recompilar. Se leen con --ajustes y,
+// con --vigilar, se recargan en caliente (ver AJUSTES EN CALIENTE).
+typedef struct { float cabeza, torso, piernas; } ProporcionesSoldado;   // escala de esos huesos
+
+typedef struct {
+    float colores[COLORES_PALETA][3];
+    float velSoldadoIzq, velSoldadoDer;          // unidades de escena por paso
+    float velPalomaIntro, velPalomaCierre;
+    ProporcionesSoldado izq, der;
+} Ajustes;
+
+Ajustes ajustes = { {}, 0.25f, 0.2f, 0.6f, 0.5f, { 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f } };   // colores: ver ajustesActuales
+
+// TEXTURAS (se cargan en segundo plano, ver recursos.h)
+GestorRecursos recursos;
+int imgPlumas = -1;
+const float COL_PLUMAS_RESPALDO[3] = {0.92f, 0.90f, 0.86f};   // la paloma mientras carga la imagen
+const int TAM_MAX_ATLAS = 2048;     // lado maximo de las paginas del atlas de sprites
+
+// GUION (guion.h): cuando pasa cada cosa y donde estan los objetos no esta
+// escrito en el codigo sino en las pistas del guion activo. GUION_BASE es la
+// historia original; --guion carga otra compilada con --compilar-guion.
+typedef enum {
+    PISTA_FIN_INTRO, PISTA_PISADAS,                  // eventos, reloj timerGlobal
+    PISTA_DESTINO_IZQ, PISTA_DESTINO_DER,            // valores en x, reloj timerGlobal
+    PISTA_POS_CASCO, PISTA_POS_ARMA_IZQ, PISTA_POS_ARMA_DER,
+    PISTA_DISPAROS, PISTA_FIN_DISPAROS,              // eventos, reloj timerDisparos
+    PISTA_LLEGADA_PALOMA,                            // valor en x, reloj timerFinal
+    PISTA_FIN_MIRAR, PISTA_FIN_SOLTAR,               // eventos, reloj timerFinal de cada subestado
+    PISTA_ARMA_FIN_IZQ, PISTA_ARMA_FIN_DER,          // valores en x, reloj timerFinal (armas soltadas)
+    PISTAS_HISTORIA
+} PistaHistoria;
+
+const char* const NOMBRES_PISTA[PISTAS_HISTORIA] = {
+    "fin_intro", "pisadas", "destino_izq", "destino_der", "pos_casco", "pos_arma_izq", "pos_arma_der",
+    "disparos", "fin_disparos", "llegada_paloma", "fin_mirar", "fin_soltar", "arma_fin_izq", "arma_fin_der",
+};
+const TipoPista TIPOS_PISTA[PISTAS_HISTORIA] = {
+    PISTA_EVENTOS, PISTA_EVENTOS, PISTA_VALOR, PISTA_VALOR, PISTA_VALOR, PISTA_VALOR, PISTA_VALOR,
+    PISTA_EVENTOS, PISTA_EVENTOS, PISTA_VALOR, PISTA_EVENTOS, PISTA_EVENTOS, PISTA_VALOR, PISTA_VALOR,
+};
+
+const char* const GUION_BASE =
+    "eventos fin_intro      20000\n"
+    "eventos pisadas        800 1600 2400 3200 4000 4800 5600 6400 7200 8000 8800 9600\n"
+    "eventos pisadas        10400 11200 12000 12800 13600 14400 15200 16000 16800 17600 18400 19200\n"
+    "valor   destino_izq    0:45\n"
+    "valor   destino_der    0:65\n"
+    "valor   pos_casco      0:35\n"
+    "valor   pos_arma_izq   0:55\n"
+    "valor   pos_arma_der   0:75\n"
+    "eventos disparos       500:100 1500:100 2500:100   # t:duracion del fogonazo\n"
+    "eventos fin_disparos   3500\n"
+    "valor   llegada_paloma 0:20\n"
+    "eventos fin_mirar      2000\n"
+    "eventos fin_soltar     1000\n"
+    "valor   arma_fin_izq   0:50\n"
+    "valor   arma_fin_der   0:60\n";
+
+Guion guion;
+int generacionHistoria = 0;     // sube cuando cambia algo que usa avanzarEscena (guion, velocidades)
+
+// Compila 'texto' en 'g'
+int compilarGuionTexto(const char* texto, const char* origen, Guion& g) {
+    std::vector<unsigned char> datos;
+    char error[256];
+    if (!guionCompilar(texto, NOMBRES_PISTA, PISTAS_HISTORIA, datos, error, sizeof(error))) {
+        printf(">> ERROR en el guion %s: %s\n", origen, error);
+        return 0;
+    }
+    return guionDesdeMemoria(std::move(datos), g);
+}
+
+// Todas las pistas que usa la historia, cada una con su tipo
+int guionCompleto(const Guion& g) {
+    for (int id = 0; id < PISTAS_HISTORIA; id++) {
+        const PistaGuion* p = guionPista(g, id);
+        if (!p) { printf(">> ERROR: al guion le falta la pista %s\n", NOMBRES_PISTA[id]); return 0; }
+        if (p->tipo != (uint32_t)TIPOS_PISTA[id]) { printf(">> ERROR: la pista %s del guion no es del tipo esperado\n", NOMBRES_PISTA[id]); return 0; }
+    }
+    return 1;
+}
+
+// Un .lgui se mapea; cualquier otro archivo se toma como texto y se compila
+int cargarGuion(const char* ruta, Guion& g) {
+    std::vector<unsigned char> bytes;
+    if (!leerArchivo(ruta, bytes)) { printf(">> ERROR: no se pudo leer %s\n", ruta); return 0; }
+    int ok;
+    if (bytes.size() >= 4 && memcmp(bytes.data(), "LGUI", 4) == 0) {
+        ok = guionAbrir(ruta, g);
+        if (!ok) printf(">> ERROR: %s no es un guion valido\n", ruta);
+    } else {
+        bytes.push_back(0);
+        ok = compilarGuionTexto((const char*)bytes.data(), ruta, g);
+    }
+    return ok && guionCompleto(g);
+}
+
+// Carga el guion de 'ruta' o, si es NULL o no sirve, el de la historia original
+void iniciarGuion(const char* ruta) {
+    if (ruta) {
+        if (cargarGuion(ruta, guion)) { printf(">> Guion %s cargado\n", ruta); return; }
+        printf(">> Se usa el guion de la historia original\n");
+    }
+    compilarGuionTexto(GUION_BASE, "base", guion);
+}
+
+// --compilar-guion: texto ("base" = el de la historia original) -> .lgui
+int compilarGuion(const char* entrada, const char* salida) {
+    std::string texto = GUION_BASE;
+    if (strcmp(entrada, "base") != 0) {
+        std::vector<unsigned char> bytes;
+        if (!leerArchivo(entrada, bytes)) { printf(">> ERROR: no se pudo leer %s\n", entrada); return -1; }
+        texto.assign(bytes.begin(), bytes.end());
+    }
+    std::vector<unsigned char> datos;
+    char error[256];
+    if (!guionCompilar(texto.c_str(), NOMBRES_PISTA, PISTAS_HISTORIA, datos, error, sizeof(error))) {
+        printf(">> ERROR en el guion %s: %s\n", entrada, error);
+        return -1;
+    }
+    Guion prueba;
+    std::vector<unsigned char> copia = datos;
+    if (!guionDesdeMemoria(std::move(copia), prueba) || !guionCompleto(prueba)) return -1;
+    if (!guionEscribir(salida, datos)) { printf(">> ERROR: no se pudo escribir %s\n", salida); return -1; }
+    printf(">> Guion %s compilado en %s (%zu bytes)\n", entrada, salida, datos.size());
+    return 0;
+}
+
+// ESTADO DE LA HISTORIA
+// Todo lo que cambia con el tiempo vive en un EstadoEscena: un struct plano
+// que se copia como bytes, asi guardar, restaurar o correr varias historias
+// a la vez es solo copiar estructuras. avanzarEscena() es una funcion pura.
+typedef struct {
+    EstadoHistoria estado;
+    SubEstadoFin subEstado;
+    int timerFinal, timerGlobal, timerDisparos, contadorDisparos, esFogonazo;
+    int inicioDisparos;             // timerGlobal al entrar en DISPAROS (reloj de las particulas)
+    float posPalomaX, posPalomaY, dirPalomaX, dirPalomaY;
+    int numPisadas;                 // huellas ya marcadas (se dibujan a partir de la cuenta)
+    float posSolIzqX, posSolDerX;
+    int tieneCasco, tieneArmaIzq, tieneArmaDer;
+    float anguloBrazo, anguloPierna;
+    uint32_t semilla;               // instancia de la historia: elige sus flujos de azar
+} EstadoEscena;
+static_assert(std::is_trivially_copyable<EstadoEscena>::value, "EstadoEscena tiene que copiarse como bytes");
+
+const EstadoEscena ESCENA_INICIAL = { INTRO, FIN_ESPERA_PALOMA, 0, 0, 0, 0, 0, 0, 10.0f, 40.0f, 1.0f, 0.5f, 0,
+                                      -15.0f, -35.0f, 0, 0, 0, 0.0f, 0.0f, 0 };
+
+// La historia que corren la ventana, el modo headless y las referencias
+EstadoEscena escena = ESCENA_INICIAL;
+
+// Azar del dibujo (azar.h): cada efecto tiene su propio flujo, que depende
+// solo de la semilla de la historia y del paso. dibujarEscena los fija en el
+// hilo antes de dibujar.
+typedef enum { AZAR_FOGONAZO_IZQ, AZAR_FOGONAZO_DER, AZAR_PARTICULAS_IZQ, AZAR_PARTICULAS_DER, AZAR_FUENTES } EfectoAzar;
+thread_local uint32_t semillaDibujo = 0, pasoDibujo = 0;
+
+inline ClaveAzar azarDibujo(EfectoAzar efecto) { return claveAzar(semillaDibujo, pasoDibujo, efecto); }
+
+// Huellas: un arreglo por campo (SoA) y uno por tipo de pie, asi cada tipo
+// se dibuja en un solo lote de instancias
+typedef enum { PISADA_PERSONA1, PISADA_PERSONA2, TIPOS_PISADA } TipoPisada;
+typedef struct { std::vector<float> x, y, angulo; } Pisadas;
+
+// Frames de 16 ms que dura la historia completa hasta el abrazo final
+const int FRAMES_HISTORIA = 2400;
+
+// --- TABLA DEL CIRCULO UNITARIO ---
+// Senos y cosenos calculados en compilacion (serie de Taylor en double) para
+// cada nivel de detalle de los ovalos. Ningun ovalo llama a trigonometria
+// mientras se dibuja.
+constexpr double senoTaylor(double x) {   // x en [-PI, PI]
+    double termino = x, suma = x;
+    for (int i = 1; i < 14; i++) { termino *= -x * x / ((2.0 * i) * (2.0 * i + 1.0)); suma += termino; }
+    return suma;
+}
+
+constexpr double cosenoTaylor(double x) {
+    double termino = 1.0, suma = 1.0;
+    for (int i = 1; i < 14; i++) { termino *= -x * x / ((2.0 * i - 1.0) * (2.0 * i)); suma += termino; }
+    return suma;
+}
+
+template <int N>
+struct TablaCirculo {
+    float x[N], y[N];
+    constexpr TablaCirculo() : x(), y() {
+        for (int i = 0; i < N; i++) {
+            double ang = 2.0 * PI * i / N;
+            if (ang > PI) ang -= 2.0 * PI;
+            x[i] = (float)cosenoTaylor(ang);
+            y[i] = (float)senoTaylor(ang);
+        }
+    }
+};
+
+constexpr TablaCirculo<8> CIRCULO_8;
+constexpr TablaCirculo<16> CIRCULO_16;
+constexpr TablaCirculo<24> CIRCULO_24;
+constexpr TablaCirculo<64> CIRCULO_64;
+static_assert(CIRCULO_24.x[6] < 1e-6f && CIRCULO_24.y[6] > 0.999999f, "tabla del circulo mal calculada");
+
+// Niveles de detalle: 8/16/24/64 lados. Se elige el menor cuyo error de cuerda
+// r*(1-cos(PI/N)) queda bajo medio pixel para el radio proyectado.
+#define NIVELES_OVALO 4
+const int LADOS_OVALO[NIVELES_OVALO] = { 8, 16, 24, 64 };
+const float RADIO_MAX_NIVEL[NIVELES_OVALO] = { 6.5f, 26.0f, 58.0f, 1e30f };
+int nivelOvaloFijo = -1;   // -1 = automatico segun tamano en pantalla (--ovalos)
+
+int nivelOvalo(float radioPx) {
+    if (nivelOvaloFijo >= 0) return nivelOvaloFijo;
+    int n = 0;
+    while (radioPx > RADIO_MAX_NIVEL[n]) n++;
+    return n;
+}
+
+// --- MALLAS ---
+// Geometria fija de las piezas, construida una vez al arrancar. Cada parte
+// se dibuja despues con una sola llamada usando la matriz actual.
+int mallaOvalo[NIVELES_OVALO];
+int mallaRect, mallaCapa, mallaPanuelo, mallaTorsoDer, mallaCasco, mallaCascoSuelo;
+int mallaPuntaRifle, mallaFogonazoExt, mallaFogonazoInt, mallaTrazadora, mallaPaloma;
+
+void construirMallas() {
+    rComenzarMalla();   // cuadrado unitario centrado, se escala a w x h
+    rBegin(R_QUADS); rVertex2f(-0.5f, -0.5f); rVertex2f(0.5f, -0.5f); rVertex2f(0.5f, 0.5f); rVertex2f(-0.5f, 0.5f); rEnd();
+    mallaRect = rTerminarMalla();
+
+    // circulo unitario en cada nivel de detalle, se escala a radioX x radioY
+    const float* tablas[NIVELES_OVALO][2] = { { CIRCULO_8.x, CIRCULO_8.y }, { CIRCULO_16.x, CIRCULO_16.y },
+                                              { CIRCULO_24.x, CIRCULO_24.y }, { CIRCULO_64.x, CIRCULO_64.y } };
+    for (int n = 0; n < NIVELES_OVALO; n++) {
+        rComenzarMalla();
+        rBegin(R_POLYGON);
+        for (int i = 0; i < LADOS_OVALO[n]; i++) rVertex2f(tablas[n][0][i], tablas[n][1][i]);
+        rEnd();
+        mallaOvalo[n] = rTerminarMalla();
+    }
+
+    rComenzarMalla();
+    rBegin(R_QUADS); rVertex2f(0, -0.8); rVertex2f(-6, -0.5); rVertex2f(-6, 0.5); rVertex2f(0, 0.8); rEnd();
+    rTranslatef(-6.0f, 0.0f, 0.0f);
+    rBegin(R_TRIANGLES); rVertex2f(0, 0.5); rVertex2f(-3, 2.0); rVertex2f(-0.5, 0); rEnd(); 
+    rBegin(R_TRIANGLES); rVertex2f(0, -0.5); rVertex2f(-3, -2.0); rVertex2f(-0.5, 0); rEnd();
+    mallaCapa = rTerminarMalla();
+
+    rComenzarMalla();
+    rBegin(R_TRIANGLES); rVertex2f(-3.0f, 1.5f); rVertex2f(3.0f, 1.5f); rVertex2f(0.0f, -2.5f); rEnd();
+    mallaPanuelo = rTerminarMalla();
+
+    rComenzarMalla();
+    rBegin(R_POLYGON); rVertex2f(-4, 6); rVertex2f(4, 6); rVertex2f(7, -5); rVertex2f(-6, -5); rEnd();
+    mallaTorsoDer = rTerminarMalla();
+
+    rComenzarMalla();
+    rRectf(-2.25f, -1.25f, 2.25f, 1.25f);
+    rBegin(R_TRIANGLES); rVertex2f(-2.25, 1.25); rVertex2f(2.25, 1.25); rVertex2f(0, 5); rEnd();
+    mallaCasco = rTerminarMalla();
+
+    rComenzarMalla();
+    rRectf(-2.0f, -1.0f, 2.0f, 1.0f);
+    rBegin(R_TRIANGLES); rVertex2f(-2,1); rVertex2f(2,1); rVertex2f(0,4); rEnd();
+    mallaCascoSuelo = rTerminarMalla();
+
+    rComenzarMalla();
+    rBegin(R_TRIANGLES); rVertex2f(0.0f, -0.3f); rVertex2f(3.0f, 0.0f); rVertex2f(0.0f, 0.3f); rEnd();
+    mallaPuntaRifle = rTerminarMalla();
+
+    rComenzarMalla();
+    rBegin(R_TRIANGLES); 
+        rVertex2f(0, 2); rVertex2f(1, 0); rVertex2f(-1, 0);
+        rVertex2f(0, -2); rVertex2f(1, 0); rVertex2f(-1, 0);
+        rVertex2f(2, 0); rVertex2f(0, 1); rVertex2f(0, -1);
+    rEnd();
+    mallaFogonazoExt = rTerminarMalla();
+
+    rComenzarMalla();
+    rBegin(R_POLYGON); rVertex2f(1,1); rVertex2f(-1,1); rVertex2f(-1,-1); rVertex2f(1,-1); rEnd();
+    mallaFogonazoInt = rTerminarMalla();
+
+    rComenzarMalla();
+    rBegin(R_LINES); rVertex2f(2.0f, 0.0f); rVertex2f(50.0f, 0.0f); rEnd();
+    mallaTrazadora = rTerminarMalla();
+
+    rComenzarMalla();
+    rBegin(R_POLYGON); 
+        rTexCoord2f(0.0f, 0.0f); rVertex2f(-4,0);
+        rTexCoord2f(0.5f, 1.0f); rVertex2f(0,-2);
+        rTexCoord2f(1.0f, 0.0f); rVertex2f(4,0);
+        rTexCoord2f(1.0f, 1.0f); rVertex2f(6,3);
+        rTexCoord2f(0.0f, 1.0f); rVertex2f(-2,4);
+    rEnd();
+    mallaPaloma = rTerminarMalla();
+
+    rSubirMallas();
+    printf(">> %d mallas, %d vertices\n", (int)mallas.size(), (int)verticesMallas.size());
+}
 
 // --- FUNCIONES AUXILIARES DE DIBUJO ---
 
-void colorRGB(const float color[3]) { glColor3fv(color); }
-void colorRGBA(const float color[3], float alpha) { glColor4f(color[0], color[1], color[2], alpha); }
+void colorRGB(const float color[3]) { rColor3fv(color); }
+void colorRGBA(const float color[3], float alpha) { rColor4f(color[0], color[1], color[2], alpha); }
 
 void dibujarRect(float w, float h, const float col[3]) {
     colorRGB(col);
-    glBegin(GL_QUADS);
-        glVertex2f(-w/2, -h/2); glVertex2f(w/2, -h/2);
-        glVertex2f(w/2, h/2); glVertex2f(-w/2, h/2);
-    glEnd();
+    rDibujarMallaEscalada(mallaRect, w, h);
 }
 
 void dibujarOvalo(float radioX, float radioY, const float col[3]) {
     colorRGB(col);
-    glBegin(GL_POLYGON);
-    for(int i=0; i<360; i+=15) {
-        float rad = i*PI/180;
-        glVertex2f(radioX*cos(rad), radioY*sin(rad));
-    }
-    glEnd();
-}
-
-void cargarTextura() {
-    printf(">> CARGANDO TEXTURA...\n");
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(1); 
-    unsigned char *data = stbi_load("plumas.jpg", &width, &height, &nrChannels, 0);
-    
-    if (data) {
-        glGenTextures(1, &texturaPlumas);
-        glBindTexture(GL_TEXTURE_2D, texturaPlumas);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        int formato = (nrChannels == 4) ? GL_RGBA : GL_RGB;
-        glTexImage2D(GL_TEXTURE_2D, 0, formato, width, height, 0, formato, GL_UNSIGNED_BYTE, data);
-        stbi_image_free(data);
-        printf(">> Textura Cargada.\n");
-    } else {
-        printf(">> ERROR: No se encontro texturas/plumas.jpg\n");
+    rDibujarMallaEscalada(mallaOvalo[nivelOvalo(rRadioEnPantalla(radioX, radioY))], radioX, radioY);
+}
+
+void detenerRecursos() { recDetener(recursos); }
+
+// Pide las texturas sin esperar: la ventana arranca enseguida y la paloma
+// usa su color de respaldo hasta que la imagen este subida
+void pedirTexturas() {
+    if (recursos.hilos.empty()) {
+        recUsarAtlas(recursos, TAM_MAX_ATLAS);
+        recIniciar(recursos, 0);
+        atexit(detenerRecursos);
     }
+    // si ya se horneo (--hornear) se mapea el .ltex en vez de decodificar el JPEG
+    FILE* horneada = fopen("plumas.ltex", "rb");
+    if (horneada) fclose(horneada);
+    imgPlumas = recPedirImagen(recursos, horneada ? "plumas.ltex" : "plumas.jpg", COL_PLUMAS_RESPALDO);
+}
+
+// Paso offline: decodifica 'entrada' una vez y la guarda como .ltex RGBA8
+// con toda la cadena de mipmaps
+int hornearTextura(const char* entrada, const char* salida) {
+    int ancho, alto, canales;
+    stbi_set_flip_vertically_on_load(1);
+    unsigned char* datos = stbi_load(entrada, &ancho, &alto, &canales, 4);
+    if (!datos) { printf(">> ERROR: no se pudo leer %s\n", entrada); return -1; }
+    std::vector<uint32_t> cadena;
+    size_t inicio[MAX_NIVELES_MIP];
+    int n = generarMipmaps((const uint32_t*)datos, ancho, alto, cadena, inicio);
+    stbi_image_free(datos);
+    const unsigned char* niveles[MAX_NIVELES_MIP];
+    for (int i = 0; i < n; i++) niveles[i] = (const unsigned char*)&cadena[inicio[i]];
+    if (!escribirLtex(salida, ancho, alto, niveles, n)) { printf(">> ERROR: no se pudo escribir %s\n", salida); return -1; }
+    printf(">> %s (%dx%d, %d niveles) horneada en %s\n", entrada, ancho, alto, n, salida);
+    return 0;
+}
+
+// Modos sin ventana: pide y espera, asi cada corrida dibuja lo mismo desde el primer frame
+void cargarTexturas() {
+    pedirTexturas();
+    recEsperarTodo(recursos);
 }
 
 // --- OBJETOS Y PERSONAJES ---
 
-void dibujarFogonazo() {
-    glPushMatrix();
-    glTranslatef(9.0f, 0.2f, 0.0f); 
-    glScalef(1.5f + (rand()%10)/10.0f, 1.5f + (rand()%10)/10.0f, 1.0f); 
-    colorRGB(COL_FUEGO_EXT);
-    glBegin(GL_TRIANGLES); 
-        glVertex2f(0, 2); glVertex2f(1, 0); glVertex2f(-1, 0);
-        glVertex2f(0, -2); glVertex2f(1, 0); glVertex2f(-1, 0);
-        glVertex2f(2, 0); glVertex2f(0, 1); glVertex2f(0, -1);
-    glEnd();
-    colorRGB(COL_FUEGO_INT);
-    glScalef(0.6f, 0.6f, 1.0f); 
-    glBegin(GL_POLYGON); glVertex2f(1,1); glVertex2f(-1,1); glVertex2f(-1,-1); glVertex2f(1,-1); glEnd();
-    glColor3f(1.0f, 1.0f, 0.8f);
-    glBegin(GL_LINES); glVertex2f(2.0f, 0.0f); glVertex2f(50.0f, 0.0f); glEnd();
-    glPopMatrix();
+// Los soldados y el rifle son rigs (esqueleto.h) armados una vez al
+// arrancar. Cada pieza lleva las condiciones en que se dibuja; la pose
+// (piernas, brazo, escala del fogonazo) se escribe en los huesos cada frame.
+enum {
+    COND_ARMA = 1, COND_FOGONAZO = 2, COND_SIN_FOGONAZO = 4,
+    COND_CASCO = 8, COND_SIN_CASCO = 16
+};
+
+// Objetos que se graban por separado (rComenzarObjeto, ver render.h): cada
+// uno se compara con lo que dibujo el mismo objeto en el frame anterior
+typedef enum {
+    OBJ_SUELO, OBJ_CASCO_SUELO, OBJ_RIFLE_SUELO_1, OBJ_RIFLE_SUELO_2,
+    OBJ_SOLDADO_IZQ, OBJ_SOLDADO_DER, OBJ_PALOMA, OBJ_HUELLAS, OBJ_PARTICULAS
+} ObjetoEscena;
+
+// Huesos que se animan; el resto del esqueleto es fijo
+typedef struct { int raiz, piernaIzq, piernaDer, brazo, fogonazo; } HuesosSoldado;
+
+Rig rigSoldadoIzq, rigSoldadoDer, rigRifle;
+HuesosSoldado huesosIzq, huesosDer;
+int generacionRigs = 0;     // sube con cada construirRigs / reconstruirSoldado
+
+// Dibujar un rig escribe su pose y sus matrices de mundo, asi que cada hilo
+// dibuja sobre su propia copia de los rigs armados por construirRigs
+struct RigsHilo {
+    int generacion = -1;
+    Rig soldadoIzq, soldadoDer, rifle;
+};
+thread_local RigsHilo rigsHilo;
+
+RigsHilo& rigsDelHilo() {
+    if (rigsHilo.generacion != generacionRigs) {
+        rigsHilo.soldadoIzq = rigSoldadoIzq; rigsHilo.soldadoDer = rigSoldadoDer; rigsHilo.rifle = rigRifle;
+        rigsHilo.generacion = generacionRigs;
+    }
+    return rigsHilo;
 }
 
-void dibujarRifle(int disparando) {
-    glPushMatrix();
-    dibujarRect(10.0f, 1.2f, COL_MADERA);
-    glTranslatef(5.0f, 0.2f, 0.0f);
-    dibujarRect(4.0f, 0.6f, COL_METAL);
-    if (disparando) dibujarFogonazo();
-    glTranslatef(2.0f, 0.0f, 0.0f);
-    glBegin(GL_TRIANGLES); glVertex2f(0.0f, -0.3f); glVertex2f(3.0f, 0.0f); glVertex2f(0.0f, 0.3f); glEnd();
-    glPopMatrix();
+// Rifle colgado de 'hueso' (el origen es el centro de la culata). Devuelve el
+// hueso del fogonazo, que se escala al azar en cada disparo.
+int agregarRifle(Rig& r, int hueso) {
+    rigPieza(r, hueso, mallaRect, 10.0f, 1.2f, COL_MADERA, COND_ARMA);
+    int canion = rigHueso(r, hueso, 5.0f, 0.2f, 0.0f, 0.0f);
+    rigPieza(r, canion, mallaRect, 4.0f, 0.6f, COL_METAL, COND_ARMA);
+    int fogonazo = rigHueso(r, canion, 9.0f, 0.2f, 0.0f, 0.0f);
+    rigPieza(r, fogonazo, mallaFogonazoExt, 1.0f, 1.0f, COL_FUEGO_EXT, COND_ARMA | COND_FOGONAZO);
+    int nucleo = rigHueso(r, fogonazo, 0.0f, 0.0f, 0.0f, 0.0f);
+    r.sx[nucleo] = 0.6f; r.sy[nucleo] = 0.6f;
+    rigPieza(r, nucleo, mallaFogonazoInt, 1.0f, 1.0f, COL_FUEGO_INT, COND_ARMA | COND_FOGONAZO);
+    rigPieza(r, nucleo, mallaTrazadora, 1.0f, 1.0f, COL_TRAZADORA, COND_ARMA | COND_FOGONAZO);
+    // la punta hereda el color de lo ultimo dibujado: metal, o la trazadora si hubo disparo
+    int punta = rigHueso(r, canion, 2.0f, 0.0f, 0.0f, 0.0f);
+    rigPieza(r, punta, mallaPuntaRifle, 1.0f, 1.0f, COL_METAL, COND_ARMA | COND_SIN_FOGONAZO);
+    rigPieza(r, punta, mallaPuntaRifle, 1.0f, 1.0f, COL_TRAZADORA, COND_ARMA | COND_FOGONAZO);
+    return fogonazo;
+}
+
+// Las proporciones escalan huesos (cabeza, torso, piernas): las piezas y los
+// hijos las heredan sin cambiar la forma del rig
+void escalarHueso(Rig& r, int hueso, float sx, float sy) { r.sx[hueso] = sx; r.sy[hueso] = sy; }
+
+void construirRigIzq(Rig& r, HuesosSoldado& h, const ProporcionesSoldado& prop) {
+    h.raiz = rigHueso(r, -1, 0.0f, 0.0f, 0.0f, 0.0f);
+    int capa = rigHueso(r, h.raiz, 3.0f, 8.0f, -0.1f, -20.0f);
+    rigPieza(r, capa, mallaCapa, 1.0f, 1.0f, COL_OSCURO, 0);
+    h.piernaIzq = rigHueso(r, h.raiz, -2.0f, -7.0f, 0.0f, 0.0f);
+    rigPieza(r, h.piernaIzq, mallaRect, 2.0f, 6.0f, COL_OSCURO, 0);
+    rigPieza(r, rigHueso(r, h.piernaIzq, 0.0f, -3.0f, 0.0f, 0.0f), MALLA_OVALO, 2.2f, 1.2f, COL_ROJO, 0);
+    h.piernaDer = rigHueso(r, h.raiz, 2.5f, -7.0f, 0.0f, 0.0f);
+    rigPieza(r, h.piernaDer, mallaRect, 2.0f, 6.0f, COL_OSCURO, 0);
+    rigPieza(r, rigHueso(r, h.piernaDer, 0.0f, -3.0f, 0.0f, 0.0f), MALLA_OVALO, 2.2f, 1.2f, COL_ROJO, 0);
+    int torso = rigHueso(r, h.raiz, 0.0f, 0.0f, 0.0f, -5.0f);
+    rigPieza(r, torso, MALLA_OVALO, 4.5f, 7.5f, COL_BLANCO, 0);
+    rigPieza(r, rigHueso(r, h.raiz, 0.0f, 4.5f, 0.1f, 0.0f), mallaPanuelo, 1.0f, 1.0f, COL_VERDE_GRIS, 0);
+    int cabeza = rigHueso(r, h.raiz, 0.5f, 8.0f, 0.1f, 0.0f);
+    rigPieza(r, cabeza, MALLA_OVALO, 2.8f, 3.2f, COL_ROJO, 0);
+    int gorro = rigHueso(r, cabeza, 0.0f, 2.5f, 0.1f, -10.0f);
+    rigPieza(r, gorro, mallaRect, 4.0f, 1.5f, COL_BLANCO, 0);
+    rigPieza(r, rigHueso(r, gorro, 0.0f, 1.0f, 0.0f, 0.0f), MALLA_OVALO, 2.0f, 1.0f, COL_BLANCO, 0);
+    int hombro = rigHueso(r, h.raiz, 3.5f, 2.5f, 0.2f, 0.0f);
+    h.brazo = rigHueso(r, hombro, 0.0f, 0.0f, 0.0f, 0.0f);    // x = -2 al disparar
+    rigPieza(r, rigHueso(r, h.brazo, -0.5f, 1.5f, 0.1f, -10.0f), mallaRect, 2.5f, 3.0f, COL_BLANCO, 0);
+    rigPieza(r, h.brazo, MALLA_OVALO, 1.5f, 3.5f, COL_ROJO, 0);
+    h.fogonazo = agregarRifle(r, rigHueso(r, h.brazo, 1.0f, -2.0f, 0.0f, 70.0f));
+    escalarHueso(r, cabeza, prop.cabeza, prop.cabeza);
+    escalarHueso(r, torso, prop.torso, prop.torso);
+    escalarHueso(r, h.piernaIzq, 1.0f, prop.piernas); escalarHueso(r, h.piernaDer, 1.0f, prop.piernas);
+    rigAgruparPorMaterial(r);
+}
+
+void construirRigDer(Rig& r, HuesosSoldado& h, const ProporcionesSoldado& prop) {
+    h.raiz = rigHueso(r, -1, 0.0f, 0.0f, 0.0f, 0.0f);
+    h.piernaIzq = rigHueso(r, h.raiz, -2.0f, -7.0f, 0.0f, 0.0f);
+    rigPieza(r, h.piernaIzq, mallaRect, 2.2f, 5.0f, COL_VERDE_GRIS, 0);
+    rigPieza(r, rigHueso(r, h.piernaIzq, 0.0f, -3.0f, 0.0f, 0.0f), MALLA_OVALO, 2.0f, 1.0f, COL_VERDE_GRIS, 0);
+    h.piernaDer = rigHueso(r, h.raiz, 2.0f, -7.0f, 0.0f, 0.0f);
+    rigPieza(r, h.piernaDer, mallaRect, 2.2f, 5.0f, COL_VERDE_GRIS, 0);
+    rigPieza(r, rigHueso(r, h.piernaDer, 0.0f, -3.0f, 0.0f, 0.0f), MALLA_OVALO, 2.0f, 1.0f, COL_VERDE_GRIS, 0);
+    int torso = rigHueso(r, h.raiz, 0.0f, 0.0f, 0.0f, 0.0f);
+    rigPieza(r, torso, mallaTorsoDer, 1.0f, 1.0f, COL_CAQUI, 0);
+    int cabeza = rigHueso(r, h.raiz, 0.0f, 7.0f, 0.1f, 0.0f);
+    rigPieza(r, cabeza, mallaCasco, 1.0f, 1.0f, COL_OSCURO, COND_CASCO);
+    rigPieza(r, rigHueso(r, cabeza, 0.0f, 2.0f, 0.1f, 0.0f), MALLA_OVALO, 0.8f, 0.8f, COL_ROJO, COND_CASCO);
+    rigPieza(r, cabeza, MALLA_OVALO, 2.5f, 3.0f, COL_ROJO, COND_SIN_CASCO);
+    int hombro = rigHueso(r, h.raiz, 4.0f, 2.0f, 0.2f, 0.0f);
+    h.brazo = rigHueso(r, hombro, 0.0f, 0.0f, 0.0f, 0.0f);    // x = -2 al disparar
+    rigPieza(r, rigHueso(r, h.brazo, 0.0f, -2.5f, -0.1f, 0.0f), MALLA_OVALO, 1.4f, 1.4f, COL_VERDE_GRIS, 0);
+    rigPieza(r, h.brazo, mallaRect, 2.0f, 5.0f, COL_CAQUI, 0);
+    int rifle = rigHueso(r, h.brazo, 0.0f, -2.5f, 0.0f, 60.0f);
+    h.fogonazo = agregarRifle(r, rifle);
+    rigPieza(r, rigHueso(r, rifle, 3.0f, 0.5f, 0.1f, 0.0f), MALLA_OVALO, 1.5f, 1.5f, COL_FONDO, COND_ARMA);
+    escalarHueso(r, cabeza, prop.cabeza, prop.cabeza);
+    escalarHueso(r, torso, prop.torso, prop.torso);
+    escalarHueso(r, h.piernaIzq, 1.0f, prop.piernas); escalarHueso(r, h.piernaDer, 1.0f, prop.piernas);
+    rigAgruparPorMaterial(r);
+}
+
+// Rearma solo el soldado 0 (izq) o 1 (der) con sus proporciones actuales
+void reconstruirSoldado(int cual) {
+    if (cual == 0) { rigSoldadoIzq = Rig(); construirRigIzq(rigSoldadoIzq, huesosIzq, ajustes.izq); }
+    else { rigSoldadoDer = Rig(); construirRigDer(rigSoldadoDer, huesosDer, ajustes.der); }
+    generacionRigs++;
+}
+
+void construirRigs() {
+    rigSoldadoIzq = Rig(); rigSoldadoDer = Rig(); rigRifle = Rig();
+    construirRigIzq(rigSoldadoIzq, huesosIzq, ajustes.izq);
+    construirRigDer(rigSoldadoDer, huesosDer, ajustes.der);
+    agregarRifle(rigRifle, rigHueso(rigRifle, -1, 0.0f, 0.0f, 0.0f, 0.0f));
+    rigAgruparPorMaterial(rigRifle);
+    generacionRigs++;
+}
+
+// Evalua el rig con la matriz actual y manda sus piezas visibles, un lote por color
+void dibujarRig(Rig& r, unsigned condiciones) {
+    ZONA_PERFIL("dibujarRig");
+    thread_local std::vector<ElementoLote> lote;
+    rigEvaluar(r, rMatrizActual());
+    int base = rReservarOrden((int)r.piezas.size());
+    const float* material = NULL;
+    lote.clear();
+    for (size_t k = 0; k <= r.porMaterial.size(); k++) {
+        const PiezaRig* p = (k < r.porMaterial.size()) ? &r.piezas[r.porMaterial[k]] : NULL;
+        if (!p || p->color != material) {
+            if (!lote.empty()) { colorRGB(material); rDibujarLote(lote.data(), (int)lote.size()); lote.clear(); }
+            if (!p) break;
+            material = p->color;
+        }
+        if (p->condicion & ~condiciones) continue;
+        ElementoLote e;
+        e.t = r.mundo[p->hueso];
+        e.t.a *= p->sx; e.t.b *= p->sx; e.t.c *= p->sy; e.t.d *= p->sy;
+        e.malla = (p->malla == MALLA_OVALO) ? mallaOvalo[nivelOvalo(radioEnPantalla(r.mundo[p->hueso], p->sx, p->sy))] : p->malla;
+        e.orden = base + r.porMaterial[k];
+        lote.push_back(e);
+    }
+}
+
+void dibujarRifle() { dibujarRig(rigsDelHilo().rifle, COND_ARMA | COND_SIN_FOGONAZO); }
+
+void dibujarRifleSuelo(ObjetoEscena objeto, float x, float grados) {
+    rComenzarObjeto(objeto);
+    rPushMatrix(); rTranslatef(x, 16.0f, 0.0f); rRotatef(grados, 0, 0, 1); dibujarRifle(); rPopMatrix();
+    rTerminarObjeto();
+}
+
+// Escribe la pose del frame en los huesos y devuelve las condiciones activas
+unsigned posarSoldado(Rig& r, const HuesosSoldado& h, float x, float y, int tieneArma,
+                      float animPiernas, float anguloBrazo, int disparando) {
+    r.x[h.raiz] = x; r.y[h.raiz] = y;
+    r.rot[h.piernaIzq] = animPiernas; r.rot[h.piernaDer] = -animPiernas;
+    r.x[h.brazo] = disparando ? -2.0f : 0.0f;
+    r.rot[h.brazo] = anguloBrazo;
+    unsigned cond = 0;
+    if (tieneArma) cond |= COND_ARMA;
+    cond |= (tieneArma && disparando) ? COND_FOGONAZO : COND_SIN_FOGONAZO;
+    return cond;
+}
+
+// Escala del fogonazo, de 1.5 a 2.4 en pasos de 0.1, distinta en cada paso
+void sortearFogonazo(Rig& r, const HuesosSoldado& h, EfectoAzar efecto) {
+    ClaveAzar c = azarDibujo(efecto);
+    r.sx[h.fogonazo] = 1.5f + (int)(azarUnidad(c, 0) * 10.0f) / 10.0f;
+    r.sy[h.fogonazo] = 1.5f + (int)(azarUnidad(c, 1) * 10.0f) / 10.0f;
 }
 
 void dibujarSoldadoIzq(float x, float y, int tieneArma, float animPiernas, float animBrazo, int apuntando, int disparando) {
-    glPushMatrix(); glTranslatef(x, y, 0.0f);
-    glPushMatrix(); glTranslatef(3.0f, 8.0f, -0.1f); glRotatef(-20.0f, 0,0,1); colorRGB(COL_OSCURO);
-    glBegin(GL_QUADS); glVertex2f(0, -0.8); glVertex2f(-6, -0.5); glVertex2f(-6, 0.5); glVertex2f(0, 0.8); glEnd();
-    glTranslatef(-6.0f, 0.0f, 0.0f);
-    glBegin(GL_TRIANGLES); glVertex2f(0, 0.5); glVertex2f(-3, 2.0); glVertex2f(-0.5, 0); glEnd(); 
-    glBegin(GL_TRIANGLES); glVertex2f(0, -0.5); glVertex2f(-3, -2.0); glVertex2f(-0.5, 0); glEnd(); glPopMatrix();
-    glPushMatrix(); glTranslatef(-2.0f, -7.0f, 0.0f); glRotatef(animPiernas, 0,0,1); dibujarRect(2.0f, 6.0f, COL_OSCURO);
-    glTranslatef(0.0f, -3.0f, 0.0f); dibujarOvalo(2.2f, 1.2f, COL_ROJO); glPopMatrix();
-    glPushMatrix(); glTranslatef(2.5f, -7.0f, 0.0f); glRotatef(-animPiernas, 0,0,1); dibujarRect(2.0f, 6.0f, COL_OSCURO);
-    glTranslatef(0.0f, -3.0f, 0.0f); dibujarOvalo(2.2f, 1.2f, COL_ROJO); glPopMatrix();
-    glPushMatrix(); glRotatef(-5.0f, 0,0,1); dibujarOvalo(4.5f, 7.5f, COL_BLANCO); glPopMatrix();
-    glPushMatrix(); glTranslatef(0.0f, 4.5f, 0.1f); colorRGB(COL_VERDE_GRIS); 
-    glBegin(GL_TRIANGLES); glVertex2f(-3.0f, 1.5f); glVertex2f(3.0f, 1.5f); glVertex2f(0.0f, -2.5f); glEnd(); glPopMatrix();
-    glPushMatrix(); glTranslatef(0.5f, 8.0f, 0.1f); dibujarOvalo(2.8f, 3.2f, COL_ROJO); 
-    glTranslatef(0.0f, 2.5f, 0.1f); glRotatef(-10.0f, 0,0,1); dibujarRect(4.0f, 1.5f, COL_BLANCO); 
-    glTranslatef(0.0f, 1.0f, 0.0f); dibujarOvalo(2.0f, 1.0f, COL_BLANCO); glPopMatrix();
-    glPushMatrix(); glTranslatef(3.5f, 2.5f, 0.2f);
-    if (disparando) glTranslatef(-2.0f, 0.0f, 0.0f);
-    if (apuntando) glRotatef(30.0f, 0,0,1); else glRotatef(animBrazo, 0,0,1);
-    glPushMatrix(); glTranslatef(-0.5f, 1.5f,0.1f); glRotatef(-10,0,0,1); dibujarRect(2.5f, 3.0f, COL_BLANCO); glPopMatrix(); 
-    dibujarOvalo(1.5f, 3.5f, COL_ROJO); 
-    if (tieneArma) { glTranslatef(1.0f, -2.0f, 0.0f); glRotatef(70.0f, 0,0,1); dibujarRifle(disparando); }
-    glPopMatrix(); glPopMatrix();
+    Rig& rig = rigsDelHilo().soldadoIzq;
+    unsigned cond = posarSoldado(rig, huesosIzq, x, y, tieneArma, animPiernas, apuntando ? 30.0f : animBrazo, disparando);
+    if (cond & COND_FOGONAZO) sortearFogonazo(rig, huesosIzq, AZAR_FOGONAZO_IZQ);
+    rComenzarObjeto(OBJ_SOLDADO_IZQ);
+    dibujarRig(rig, cond);
+    rTerminarObjeto();
 }
 
 void dibujarSoldadoDer(float x, float y, int tieneCasco, int tieneArma, float animPiernas, float animBrazo, int apuntando, int disparando) {
-    glPushMatrix(); glTranslatef(x, y, 0.0f);
-    glPushMatrix(); glTranslatef(-2.0f, -7.0f, 0.0f); glRotatef(animPiernas, 0,0,1); dibujarRect(2.2f, 5.0f, COL_VERDE_GRIS);
-    glTranslatef(0.0f, -3.0f, 0.0f); dibujarOvalo(2.0f, 1.0f, COL_VERDE_GRIS); glPopMatrix();
-    glPushMatrix(); glTranslatef(2.0f, -7.0f, 0.0f); glRotatef(-animPiernas, 0,0,1); dibujarRect(2.2f, 5.0f, COL_VERDE_GRIS);
-    glTranslatef(0.0f, -3.0f, 0.0f); dibujarOvalo(2.0f, 1.0f, COL_VERDE_GRIS); glPopMatrix();
-    colorRGB(COL_CAQUI); glBegin(GL_POLYGON); glVertex2f(-4, 6); glVertex2f(4, 6); glVertex2f(7, -5); glVertex2f(-6, -5); glEnd();
-    glPushMatrix(); glTranslatef(0.0f, 7.0f, 0.1f);
-    if (tieneCasco) {
-        colorRGB(COL_OSCURO); dibujarRect(4.5f, 2.5f, COL_OSCURO);
-        glBegin(GL_TRIANGLES); glVertex2f(-2.25, 1.25); glVertex2f(2.25, 1.25); glVertex2f(0, 5); glEnd();
-        glTranslatef(0.0f, 2.0f, 0.1f); dibujarOvalo(0.8f, 0.8f, COL_ROJO); 
-    } else { dibujarOvalo(2.5f, 3.0f, COL_ROJO); }
-    glPopMatrix();
-    glPushMatrix(); glTranslatef(4.0f, 2.0f, 0.2f);
-    if (disparando) glTranslatef(-2.0f, 0.0f, 0.0f);
-    if (apuntando) glRotatef(40.0f, 0,0,1); else glRotatef(animBrazo, 0,0,1);
-    glPushMatrix(); glTranslatef(0.0f, -2.5f, -0.1f); dibujarOvalo(1.4f, 1.4f, COL_VERDE_GRIS); glPopMatrix();
-    dibujarRect(2.0f, 5.0f, COL_CAQUI); 
-    if (tieneArma) { glTranslatef(0.0f, -2.5f, 0.0f); glRotatef(60.0f, 0,0,1); dibujarRifle(disparando); 
-    glTranslatef(3.0f, 0.5f, 0.1f); colorRGBA(COL_FONDO, 0.8f); dibujarOvalo(1.5f, 1.5f, COL_FONDO); }
-    glPopMatrix(); glPopMatrix();
-}
-
-void dibujarPaloma(float x, float y, int mirandoAbajo) {
-    glPushMatrix(); glTranslatef(x, y, 0.0f);
-    if (mirandoAbajo) glRotatef(-30.0f, 0,0,1);
+    Rig& rig = rigsDelHilo().soldadoDer;
+    unsigned cond = posarSoldado(rig, huesosDer, x, y, tieneArma, animPiernas, apuntando ? 40.0f : animBrazo, disparando);
+    if (cond & COND_FOGONAZO) sortearFogonazo(rig, huesosDer, AZAR_FOGONAZO_DER);
+    cond |= tieneCasco ? COND_CASCO : COND_SIN_CASCO;
+    rComenzarObjeto(OBJ_SOLDADO_DER);
+    dibujarRig(rig, cond);
+    rTerminarObjeto();
+}
+
+void dibujarPaloma(float x, float y, int mirandoAbajo, int timerGlobal) {
+    rComenzarObjeto(OBJ_PALOMA);
+    rPushMatrix(); rTranslatef(x, y, 0.0f);
+    if (mirandoAbajo) rRotatef(-30.0f, 0,0,1);
     float aleteo = sin(timerGlobal * 0.01f) * 3.0f;
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, texturaPlumas);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glBegin(GL_POLYGON); 
-        glTexCoord2f(0.0f, 0.0f); glVertex2f(-4,0);
-        glTexCoord2f(0.5f, 1.0f); glVertex2f(0,-2);
-        glTexCoord2f(1.0f, 0.0f); glVertex2f(4,0);
-        glTexCoord2f(1.0f, 1.0f); glVertex2f(6,3);
-        glTexCoord2f(0.0f, 1.0f); glVertex2f(-2,4);
-    glEnd();
-    glDisable(GL_TEXTURE_2D);
+    const VistaRecurso* plumas = recVista(recursos, imgPlumas);
+    unsigned int textura = plumas ? plumas->textura : 0;
+    if (textura) { rEnableTextura(textura, plumas->uv); rColor3f(1.0f, 1.0f, 1.0f); }
+    else colorRGB(plumas ? plumas->respaldo : COL_PLUMAS_RESPALDO);
+    rDibujarMalla(mallaPaloma);
+    if (textura) rDisableTextura();
     colorRGBA(COL_BLANCO, 0.6f); 
-    glBegin(GL_TRIANGLES); glVertex2f(-2, 2); glVertex2f(-8, 6 + aleteo); glVertex2f(2, 4); glEnd();
-    glBegin(GL_TRIANGLES); glVertex2f(2, 2); glVertex2f(8, 6 + aleteo); glVertex2f(-2, 4); glEnd();
-    glPopMatrix();
+    rBegin(R_TRIANGLES); rVertex2f(-2, 2); rVertex2f(-8, 6 + aleteo); rVertex2f(2, 4); rEnd();
+    rBegin(R_TRIANGLES); rVertex2f(2, 2); rVertex2f(8, 6 + aleteo); rVertex2f(-2, 4); rEnd();
+    rPopMatrix();
+    rTerminarObjeto();
+}
+
+// --- HUELLAS ---
+// Cada huella depende solo de su numero y de la direccion de la paloma: el
+// estado guarda cuantas hay y cada hilo arma los arreglos al dibujar.
+
+// Calcula la huella numero i (0..11 persona 1, 12..23 persona 2) a lo largo
+// de la direccion (dirX, dirY) y la agrega a su arreglo
+void agregarPisada(Pisadas* pisadas, int i, float dirX, float dirY) {
+    int esPersona2 = (i >= 12);
+    int indicePaso = esPersona2 ? (i - 12) : i;
+    int esPieIzquierdo = (indicePaso % 2 == 0);
+    float offsetLateralPie = esPieIzquierdo ? -1.5f : 1.5f;
+    float offsetPersona = esPersona2 ? 8.0f : 0.0f; 
+    float distancia = 10.0f + indicePaso * 7.0f; 
+    float pxBase = distancia * dirX; float pyBase = distancia * dirY;
+    float offsetTotal = offsetLateralPie + offsetPersona;
+    float angulo = atan2(dirX, dirY) * 180 / PI;
+    Pisadas& p = pisadas[esPersona2 ? PISADA_PERSONA2 : PISADA_PERSONA1];
+    p.x.push_back(pxBase - offsetTotal * dirY);
+    p.y.push_back(pyBase + offsetTotal * dirX);
+    p.angulo.push_back((angulo - 90) * 3.14159265f / 180.0f);
+}
+
+struct HuellasHilo {
+    int cantidad = 0;
+    float dirX = 0.0f, dirY = 0.0f;
+    Pisadas tipo[TIPOS_PISADA];
+};
+thread_local HuellasHilo huellasHilo;
+
+// Deja en el cache del hilo las huellas de 'e' (solo agrega las que faltan)
+const Pisadas* pisadasDe(const EstadoEscena& e) {
+    HuellasHilo& h = huellasHilo;
+    if (h.cantidad > e.numPisadas || h.dirX != e.dirPalomaX || h.dirY != e.dirPalomaY) {
+        for (int t = 0; t < TIPOS_PISADA; t++) { h.tipo[t].x.clear(); h.tipo[t].y.clear(); h.tipo[t].angulo.clear(); }
+        h.cantidad = 0; h.dirX = e.dirPalomaX; h.dirY = e.dirPalomaY;
+    }
+    while (h.cantidad < e.numPisadas) agregarPisada(h.tipo, h.cantidad++, h.dirX, h.dirY);
+    return h.tipo;
+}
+
+// --- PARTICULAS ---
+// Chispas, humo y casquillos de los disparos. Igual que las huellas dependen
+// solo del estado: el reloj es el paso desde que empezo DISPAROS, cada
+// particula sale de la boca en un paso conocido con el azar de ese paso y vive
+// un tiempo fijo. Para dibujar un paso se recorren los pasos de disparo que
+// pueden tener particulas vivas y cada una se emite ya envejecida hasta el
+// paso pedido (partEmitirConEdad), sin repetir la historia: el costo no
+// depende del paso, ni de la sesion, ni del orden en que los hilos dibujan.
+typedef enum { PART_CHISPA, PART_HUMO, PART_CASQUILLO, TIPOS_PARTICULA } TipoParticula;
+
+const FisicaParticulas FISICA_PARTICULAS[TIPOS_PARTICULA] = {
+    { -40.0f, 2.0f, 0.0f, 15.0f, 0.2f, 0.5f },    // chispa: rapida, apenas rebota
+    { 3.0f, 0.9f, 1.5f, 0.0f, -1.0f, 1.0f },      // humo: sube, se frena y se abre
+    { -90.0f, 0.2f, 0.0f, 15.3f, 0.35f, 0.6f },   // casquillo: cae y queda en el suelo
+};
+const int CAPACIDAD_PARTICULAS = 4096;   // por tipo; la historia usa unos cientos
+const int CHISPAS_POR_PASO = 10, HUMO_POR_PASO = 2;
+const float VIDA_MAX_CHISPA = 0.32f, VIDA_MAX_HUMO = 3.5f;   // s
+const float VIDA_CASQUILLO = 10.0f;      // s: los de la historia llegan al abrazo final
+
+struct ParticulasHilo {
+    int paso = -1;                                   // -1 = sin iniciar
+    uint32_t semilla = 0;                            // historia de la que son
+    int generacion = -1;                             // generacionHistoria con que se calcularon
+    int generacionBocas = -1;                        // generacionRigs con que se calcularon las bocas
+    float posIzq = 0.0f, posDer = 0.0f;              // soldados con que se calcularon las bocas
+    float boca[2][4];                                // por soldado: x, y y direccion del canion
+    PoolParticulas tipo[TIPOS_PARTICULA];
+};
+thread_local ParticulasHilo particulasHilo;
+
+// Paso de los efectos de 'e' (0 al entrar en DISPAROS), -1 si aun no hubo disparos
+int pasoEfectos(const EstadoEscena& e) {
+    if (e.estado != DISPAROS && e.estado != CIERRE) return -1;
+    return (e.timerGlobal - e.inicioDisparos) / PASO_MS;
+}
+
+// Punta del canion y su direccion con la pose de disparo de dibujarDisparos
+// (sin sortear la escala del fogonazo, que no mueve el hueso)
+void bocaDeFuego(Rig& r, const HuesosSoldado& h, float x, float anguloBrazo, float boca[4]) {
+    posarSoldado(r, h, x, 25.0f, 1, 0.0f, anguloBrazo, 0);
+    r.x[h.brazo] = -2.0f;
+    Matriz2D identidad = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
+    rigEvaluar(r, identidad);
+    const Matriz2D& m = r.mundo[h.fogonazo];
+    float largo = sqrtf(m.a * m.a + m.b * m.b);
+    boca[0] = m.tx; boca[1] = m.ty; boca[2] = m.a / largo; boca[3] = m.b / largo;
+}
+
+// Lo que salio de cada boca en el paso 'paso' (ms = paso * PASO_MS desde
+// DISPAROS), movido 'edad' pasos. Los numeros de cada soldado salen de un solo
+// azarLlenar por paso, asi no dependen de la edad con que se piden.
+void emitirParticulas(ParticulasHilo& h, int paso, int edad) {
+    const int NUMEROS = 3 * (CHISPAS_POR_PASO + HUMO_POR_PASO + 1);
+    const float dt = PASO_MS / 1000.0f;
+    int ms = paso * PASO_MS;
+    int disparo = guionEventoEn(guion, PISTA_DISPAROS, (float)ms);
+    if (disparo < 0) return;
+    int primero = (ms - PASO_MS <= guionClave(guion, PISTA_DISPAROS, disparo)->t);
+    if (!primero && edad * dt >= VIDA_MAX_HUMO) return;   // todo lo de este paso ya murio
+    for (int s = 0; s < 2; s++) {
+        const float* b = h.boca[s];
+        float azar[NUMEROS];
+        azarLlenar(claveAzar(h.semilla, (uint32_t)paso, s ? AZAR_PARTICULAS_DER : AZAR_PARTICULAS_IZQ), 0, azar, NUMEROS);
+        const float* a = azar;
+        for (int i = 0; i < CHISPAS_POR_PASO; i++, a += 3) {
+            float desvio = (a[0] - 0.5f) * 0.8f;
+            float vel = 40.0f + 50.0f * a[1];
+            float dx = b[2] - b[3] * desvio, dy = b[3] + b[2] * desvio;
+            partEmitirConEdad(h.tipo[PART_CHISPA], b[0], b[1], dx * vel, dy * vel, 0.12f + (VIDA_MAX_CHISPA - 0.12f) * a[2],
+                              0.0f, 0.0f, 1.0f, edad, dt);
+        }
+        for (int i = 0; i < HUMO_POR_PASO; i++, a += 3) {
+            float vel = 4.0f + 6.0f * a[0];
+            partEmitirConEdad(h.tipo[PART_HUMO], b[0] + b[2], b[1] + b[3], b[2] * vel, b[3] * vel + 2.0f,
+                              1.5f + (VIDA_MAX_HUMO - 1.5f) * a[1], 0.0f, 0.0f, 0.6f + 0.4f * a[2], edad, dt);
+        }
+        if (primero) {   // el casquillo sale hacia atras y arriba desde la recamara
+            float px = b[0] - 11.0f * b[2], py = b[1] - 11.0f * b[3];
+            float lado = (b[2] >= 0.0f) ? -1.0f : 1.0f;
+            partEmitirConEdad(h.tipo[PART_CASQUILLO], px, py, lado * (6.0f + 6.0f * a[0]), 20.0f + 8.0f * a[1],
+                              VIDA_CASQUILLO, 0.0f, lado * (10.0f + 10.0f * a[2]), 1.0f, edad, dt);
+        }
+    }
+}
+
+// Deja en el cache del hilo las particulas de 'e'; NULL si aun no hubo disparos.
+// Se arman de cero en cada paso nuevo, en orden de emision.
+const PoolParticulas* particulasDe(const EstadoEscena& e) {
+    ParticulasHilo& h = particulasHilo;
+    int paso = pasoEfectos(e);
+    if (paso < 0) return NULL;
+    if (h.paso < 0)
+        for (int t = 0; t < TIPOS_PARTICULA; t++) partIniciar(h.tipo[t], CAPACIDAD_PARTICULAS, FISICA_PARTICULAS[t]);
+    int mismasBocas = h.generacionBocas == generacionRigs && h.posIzq == e.posSolIzqX && h.posDer == e.posSolDerX;
+    if (mismasBocas && h.paso == paso && h.semilla == e.semilla && h.generacion == generacionHistoria) return h.tipo;
+    if (!mismasBocas) {
+        h.generacionBocas = generacionRigs; h.posIzq = e.posSolIzqX; h.posDer = e.posSolDerX;
+        RigsHilo& rigs = rigsDelHilo();
+        bocaDeFuego(rigs.soldadoIzq, huesosIzq, h.posIzq, 30.0f, h.boca[0]);
+        bocaDeFuego(rigs.soldadoDer, huesosDer, h.posDer, 40.0f, h.boca[1]);
+    }
+    h.paso = paso; h.semilla = e.semilla; h.generacion = generacionHistoria;
+    for (int t = 0; t < TIPOS_PARTICULA; t++) partVaciar(h.tipo[t]);
+    // cada disparo empezado: sus pasos (los del evento, hasta el pedido)
+    int ms = paso * PASO_MS;
+    int disparos = guionAntes(guion, PISTA_DISPAROS, (float)ms);
+    for (int d = 0; d < disparos; d++) {
+        const ClaveGuion* c = guionClave(guion, PISTA_DISPAROS, d);
+        int desde = std::max(0, (int)floorf(c->t / PASO_MS) + 1);
+        for (int k = desde; k <= paso && k * PASO_MS < c->t + c->valor; k++)
+            if (guionEventoEn(guion, PISTA_DISPAROS, (float)(k * PASO_MS)) == d) emitirParticulas(h, k, paso - k);
+    }
+    return h.tipo;
+}
+
+// Cada tipo es un solo lote de instancias
+void dibujarParticulas(const EstadoEscena& e) {
+    ZONA_PERFIL("dibujarParticulas");
+    if (!particulasDe(e)) return;
+    PoolParticulas* p = particulasHilo.tipo;
+    rComenzarObjeto(OBJ_PARTICULAS);
+    partMatrices(p[PART_CASQUILLO], 0.9f, 0.4f, 0.05f, 0, NULL);
+    colorRGB(COL_LATON);
+    rDibujarInstanciasMatriz(mallaRect, p[PART_CASQUILLO].matrices.data(), p[PART_CASQUILLO].vivas);
+    partMatrices(p[PART_HUMO], 1.0f, 1.0f, 0.8f, 0, NULL);
+    colorRGBA(COL_HUMO, 0.35f);
+    rDibujarInstanciasMatriz(mallaOvalo[1], p[PART_HUMO].matrices.data(), p[PART_HUMO].vivas);
+    partMatrices(p[PART_CHISPA], 1.2f, 0.15f, 1.0f, 1, NULL);
+    colorRGB(COL_FUEGO_INT);
+    rDibujarInstanciasMatriz(mallaRect, p[PART_CHISPA].matrices.data(), p[PART_CHISPA].vivas);
+    rTerminarObjeto();
 }
 
 // --- ESCENAS ---
-void dibujarIntro() {
-    dibujarPaloma(posPalomaX, posPalomaY, 0);
+void dibujarSuelo() {
+    rComenzarObjeto(OBJ_SUELO);
+    rColor3f(0.8f, 0.77f, 0.7f); rRectf(0.0f, 0.0f, 100.0f, 15.0f);
+    rTerminarObjeto();
+}
+
+void dibujarIntro(const EstadoEscena& e) {
+    ZONA_PERFIL("dibujarIntro");
+    dibujarPaloma(e.posPalomaX, e.posPalomaY, 0, e.timerGlobal);
+    const Pisadas* pisadas = pisadasDe(e);
+    const Pisadas& p1 = pisadas[PISADA_PERSONA1];
+    const Pisadas& p2 = pisadas[PISADA_PERSONA2];
+    rComenzarObjeto(OBJ_HUELLAS);
     colorRGB(COL_OSCURO);
-    float angulo = atan2(dirPalomaX, dirPalomaY) * 180 / PI;
-    for(int i=0; i < numPisadasTotal; i++) {
-        int esPersona2 = (i >= 12);
-        int indicePaso = esPersona2 ? (i - 12) : i;
-        int esPieIzquierdo = (indicePaso % 2 == 0);
-        float offsetLateralPie = esPieIzquierdo ? -1.5f : 1.5f;
-        float offsetPersona = esPersona2 ? 8.0f : 0.0f; 
-        float distancia = 10.0f + indicePaso * 7.0f; 
-        float pxBase = distancia * dirPalomaX; float pyBase = distancia * dirPalomaY;
-        float offsetTotal = offsetLateralPie + offsetPersona;
-        float pxFinal = pxBase - offsetTotal * dirPalomaY; float pyFinal = pyBase + offsetTotal * dirPalomaX;
-        glPushMatrix(); glTranslatef(pxFinal, pyFinal, 0.0f); glRotatef(angulo - 90, 0,0,1);
-        if (esPersona2) dibujarOvalo(1.4f, 0.7f, COL_VERDE_GRIS); else dibujarRect(2.5f, 1.2f, COL_OSCURO); 
-        glPopMatrix();
-    }
-}
-
-void dibujarDesarrollo() {
-    glColor3f(0.8f, 0.77f, 0.7f); glRectf(0.0f, 0.0f, 100.0f, 15.0f);
-    if (!tieneCasco) {
-        glPushMatrix(); glTranslatef(POS_CASCO, 17.0f, 0.0f); glRotatef(-20,0,0,1);
-        colorRGB(COL_OSCURO); dibujarRect(4.0f, 2.0f, COL_OSCURO);
-        glBegin(GL_TRIANGLES); glVertex2f(-2,1); glVertex2f(2,1); glVertex2f(0,4); glEnd(); glPopMatrix();
-    }
-    if (!tieneArmaIzq) { glPushMatrix(); glTranslatef(POS_ARMA_IZQ, 16.0f, 0.0f); glRotatef(5,0,0,1); dibujarRifle(0); glPopMatrix(); }
-    if (!tieneArmaDer) { glPushMatrix(); glTranslatef(POS_ARMA_DER, 16.0f, 0.0f); glRotatef(-5,0,0,1); dibujarRifle(0); glPopMatrix(); }
-    dibujarSoldadoIzq(posSolIzqX, 25.0f, tieneArmaIzq, anguloPierna, anguloBrazo, 0, 0);
-    dibujarSoldadoDer(posSolDerX, 25.0f, tieneCasco, tieneArmaDer, -anguloPierna, -anguloBrazo, 0, 0);
-}
-
-void dibujarDisparos() {
-    glColor3f(0.8f, 0.77f, 0.7f); glRectf(0.0f, 0.0f, 100.0f, 15.0f);
-    dibujarSoldadoIzq(posSolIzqX, 25.0f, 1, 0, 0, 1, esFogonazo);
-    dibujarSoldadoDer(posSolDerX, 25.0f, tieneCasco, 1, 0, 0, 1, esFogonazo);
-}
-
-void dibujarCierre() {
-    glColor3f(0.8f, 0.77f, 0.7f); glRectf(0.0f, 0.0f, 100.0f, 15.0f);
-    if (subEstadoActual >= FIN_SOLTAR) {
-         glPushMatrix(); glTranslatef(50.0f, 16.0f, 0.0f); glRotatef(10,0,0,1); dibujarRifle(0); glPopMatrix();
-         glPushMatrix(); glTranslatef(60.0f, 16.0f, 0.0f); glRotatef(-15,0,0,1); dibujarRifle(0); glPopMatrix();
-    }
-    int apuntando = (subEstadoActual == FIN_ESPERA_PALOMA || subEstadoActual == FIN_MIRAR);
-    float abrazoAnim = (subEstadoActual == FIN_ABRAZO) ? 45.0f : (apuntando ? 0 : anguloBrazo);
-    float offsetIzq = (subEstadoActual == FIN_ABRAZO) ? 7.0f : 0.0f;
-    float offsetDer = (subEstadoActual == FIN_ABRAZO) ? -7.0f : 0.0f;
-    dibujarSoldadoIzq(posSolIzqX + offsetIzq, 25.0f, (subEstadoActual < FIN_SOLTAR), 0, abrazoAnim, apuntando, 0);
-    dibujarSoldadoDer(posSolDerX + offsetDer, 25.0f, tieneCasco, (subEstadoActual < FIN_SOLTAR), 0, -abrazoAnim, apuntando, 0);
-    dibujarPaloma(posPalomaX, posPalomaY, (subEstadoActual == FIN_MIRAR));
+    rDibujarInstancias(mallaRect, 2.5f, 1.2f, p1.x.data(), p1.y.data(), p1.angulo.data(), (int)p1.x.size());
+    colorRGB(COL_VERDE_GRIS);
+    rDibujarInstancias(mallaOvalo[nivelOvalo(rRadioEnPantalla(1.4f, 0.7f))], 1.4f, 0.7f,
+                       p2.x.data(), p2.y.data(), p2.angulo.data(), (int)p2.x.size());
+    rTerminarObjeto();
+}
+
+void dibujarDesarrollo(const EstadoEscena& e) {
+    ZONA_PERFIL("dibujarDesarrollo");
+    dibujarSuelo();
+    if (!e.tieneCasco) {
+        rComenzarObjeto(OBJ_CASCO_SUELO);
+        rPushMatrix(); rTranslatef(guionValor(guion, PISTA_POS_CASCO, (float)e.timerGlobal), 17.0f, 0.0f); rRotatef(-20,0,0,1);
+        colorRGB(COL_OSCURO); rDibujarMalla(mallaCascoSuelo); rPopMatrix();
+        rTerminarObjeto();
+    }
+    float t = (float)e.timerGlobal;
+    if (!e.tieneArmaIzq) dibujarRifleSuelo(OBJ_RIFLE_SUELO_1, guionValor(guion, PISTA_POS_ARMA_IZQ, t), 5.0f);
+    if (!e.tieneArmaDer) dibujarRifleSuelo(OBJ_RIFLE_SUELO_2, guionValor(guion, PISTA_POS_ARMA_DER, t), -5.0f);
+    dibujarSoldadoIzq(e.posSolIzqX, 25.0f, e.tieneArmaIzq, e.anguloPierna, e.anguloBrazo, 0, 0);
+    dibujarSoldadoDer(e.posSolDerX, 25.0f, e.tieneCasco, e.tieneArmaDer, -e.anguloPierna, -e.anguloBrazo, 0, 0);
+}
+
+void dibujarDisparos(const EstadoEscena& e) {
+    ZONA_PERFIL("dibujarDisparos");
+    dibujarSuelo();
+    dibujarSoldadoIzq(e.posSolIzqX, 25.0f, 1, 0, 0, 1, e.esFogonazo);
+    dibujarSoldadoDer(e.posSolDerX, 25.0f, e.tieneCasco, 1, 0, 0, 1, e.esFogonazo);
+    dibujarParticulas(e);
+}
+
+void dibujarCierre(const EstadoEscena& e) {
+    ZONA_PERFIL("dibujarCierre");
+    dibujarSuelo();
+    if (e.subEstado >= FIN_SOLTAR) {
+        float tf = (float)e.timerFinal;
+        dibujarRifleSuelo(OBJ_RIFLE_SUELO_1, guionValor(guion, PISTA_ARMA_FIN_IZQ, tf), 10.0f);
+        dibujarRifleSuelo(OBJ_RIFLE_SUELO_2, guionValor(guion, PISTA_ARMA_FIN_DER, tf), -15.0f);
+    }
+    int apuntando = (e.subEstado == FIN_ESPERA_PALOMA || e.subEstado == FIN_MIRAR);
+    float abrazoAnim = (e.subEstado == FIN_ABRAZO) ? 45.0f : (apuntando ? 0 : e.anguloBrazo);
+    float offsetIzq = (e.subEstado == FIN_ABRAZO) ? 7.0f : 0.0f;
+    float offsetDer = (e.subEstado == FIN_ABRAZO) ? -7.0f : 0.0f;
+    dibujarSoldadoIzq(e.posSolIzqX + offsetIzq, 25.0f, (e.subEstado < FIN_SOLTAR), 0, abrazoAnim, apuntando, 0);
+    dibujarSoldadoDer(e.posSolDerX + offsetDer, 25.0f, e.tieneCasco, (e.subEstado < FIN_SOLTAR), 0, -abrazoAnim, apuntando, 0);
+    dibujarPaloma(e.posPalomaX, e.posPalomaY, (e.subEstado == FIN_MIRAR), e.timerGlobal);
+    dibujarParticulas(e);
+}
+
+// --- MODO MULTITUD ---
+// Prueba de carga: N soldados en grilla marchando en el lugar, cada uno con
+// su propia fase de piernas y brazos. Los rigs se evaluan en paralelo en
+// poolMultitud y cada pieza se dibuja como un solo lote de instancias para
+// todos los soldados de un mismo tipo.
+int numMultitud = 0;                // 0 = historia normal
+float objetivoMs = 16.0f;           // tiempo de frame que se quiere sostener
+PoolHilos poolMultitud;
+
+#define TAM_TANDA_MULTITUD 256
+#define ANCHO_SOLDADO 24.0f         // caja aproximada de un soldado con el rifle
+#define ALTO_SOLDADO 32.0f
+
+typedef struct {
+    Rig* rig;
+    const HuesosSoldado* huesos;
+    unsigned condiciones;
+    std::vector<float> x, y, fase;                  // por soldado (SoA)
+    std::vector<float> anguloPierna, anguloBrazo;
+    std::vector<int> visibles;                      // piezas que se dibujan con 'condiciones'
+    std::vector<std::vector<Matriz2D>> matrices;    // [pieza visible][soldado]
+} GrupoMultitud;
+
+GrupoMultitud multitud[2];
+float escalaMultitud = 1.0f;
+
+void iniciarMultitud(int n) {
+    numMultitud = n;
+    multitud[0].rig = &rigSoldadoIzq; multitud[0].huesos = &huesosIzq;
+    multitud[0].condiciones = COND_ARMA | COND_SIN_FOGONAZO;
+    multitud[1].rig = &rigSoldadoDer; multitud[1].huesos = &huesosDer;
+    multitud[1].condiciones = COND_ARMA | COND_SIN_FOGONAZO | COND_CASCO;
+
+    // Grilla en x 2..98, y 5..95 con celdas de la proporcion de un soldado
+    int columnas = (int)ceilf(sqrtf(n * (96.0f / 90.0f) * (ALTO_SOLDADO / ANCHO_SOLDADO)));
+    int filas = (n + columnas - 1) / columnas;
+    float anchoCelda = 96.0f / columnas, altoCelda = 90.0f / filas;
+    escalaMultitud = fminf(anchoCelda / ANCHO_SOLDADO, altoCelda / ALTO_SOLDADO);
+
+    for (int t = 0; t < 2; t++) {
+        GrupoMultitud& g = multitud[t];
+        g.x.clear(); g.y.clear(); g.fase.clear();
+        g.visibles.clear();
+        for (size_t p = 0; p < g.rig->piezas.size(); p++)
+            if (!(g.rig->piezas[p].condicion & ~g.condiciones)) g.visibles.push_back((int)p);
+    }
+    for (int i = 0; i < n; i++) {
+        int fila = i / columnas, col = i % columnas;
+        GrupoMultitud& g = multitud[(fila + col) % 2];
+        // el centro de la caja del soldado queda en (4, -1) de su esqueleto
+        g.x.push_back(2.0f + (col + 0.5f) * anchoCelda - 4.0f * escalaMultitud);
+        g.y.push_back(95.0f - (fila + 0.5f) * altoCelda + 1.0f * escalaMultitud);
+        g.fase.push_back(fmodf(i * 2.39996f, 2.0f * (float)PI));   // angulo aureo: fases bien repartidas
+    }
+    for (int t = 0; t < 2; t++) {
+        GrupoMultitud& g = multitud[t];
+        size_t cant = g.x.size();
+        g.anguloPierna.assign(cant, 0.0f); g.anguloBrazo.assign(cant, 0.0f);
+        g.matrices.assign(g.visibles.size(), std::vector<Matriz2D>(cant));
+    }
+    printf(">> MULTITUD: %d soldados en grilla de %dx%d (escala %.3f, %d hilo(s))\n",
+           n, columnas, filas, escalaMultitud, poolNumHilos(poolMultitud));
+}
+
+// Pose de cada soldado y evaluacion de su rig, repartido en tandas entre los
+// hilos. Cada tanda trabaja sobre su propia copia del rig.
+void actualizarMultitud() {
+    ZONA_PERFIL("actualizarMultitud");
+    for (int t = 0; t < 2; t++) {
+        GrupoMultitud& g = multitud[t];
+        int cant = (int)g.x.size();
+        int tandas = (cant + TAM_TANDA_MULTITUD - 1) / TAM_TANDA_MULTITUD;
+        poolParaCada(poolMultitud, tandas, [&](int k) {
+            Rig r = *g.rig;
+            int fin = std::min(cant, (k + 1) * TAM_TANDA_MULTITUD);
+            for (int i = k * TAM_TANDA_MULTITUD; i < fin; i++) {
+                float fase = escena.timerGlobal * 0.005f + g.fase[i];
+                g.anguloPierna[i] = sinf(fase) * 30.0f;
+                g.anguloBrazo[i] = sinf(fase) * 15.0f;
+                posarSoldado(r, *g.huesos, 0.0f, 0.0f, 1, t ? -g.anguloPierna[i] : g.anguloPierna[i],
+                             t ? -g.anguloBrazo[i] : g.anguloBrazo[i], 0);
+                Matriz2D raiz = { escalaMultitud, 0.0f, 0.0f, escalaMultitud, g.x[i], g.y[i], 0.0f };
+                rigEvaluar(r, raiz);
+                for (size_t v = 0; v < g.visibles.size(); v++) {
+                    const PiezaRig& p = r.piezas[g.visibles[v]];
+                    Matriz2D m = r.mundo[p.hueso];
+                    m.a *= p.sx; m.b *= p.sx; m.c *= p.sy; m.d *= p.sy;
+                    g.matrices[v][i] = m;
+                }
+            }
+        });
+    }
 }
 
+void dibujarMultitud() {
+    ZONA_PERFIL("dibujarMultitud");
+    rColor3f(0.8f, 0.77f, 0.7f); rRectf(0.0f, 0.0f, 100.0f, 4.0f);
+    for (int t = 0; t < 2; t++) {
+        GrupoMultitud& g = multitud[t];
+        if (g.x.empty()) continue;
+        for (size_t v = 0; v < g.visibles.size(); v++) {
+            const PiezaRig& p = g.rig->piezas[g.visibles[v]];
+            int malla = p.malla;
+            if (malla == MALLA_OVALO) malla = mallaOvalo[nivelOvalo(radioEnPantalla(g.matrices[v][0], 1.0f, 1.0f))];
+            colorRGB(p.color);
+            rDibujarInstanciasMatriz(malla, g.matrices[v].data(), (int)g.x.size());
+        }
+    }
+}
+
+void dibujarEscena(const EstadoEscena& e) {
+    if (numMultitud > 0) { dibujarMultitud(); return; }
+    semillaDibujo = e.semilla;
+    pasoDibujo = (uint32_t)(e.timerGlobal / PASO_MS);
+    switch(e.estado) {
+        case INTRO: dibujarIntro(e); break;
+        case DESARROLLO: dibujarDesarrollo(e); break;
+        case DISPAROS: dibujarDisparos(e); break;
+        case CIERRE: dibujarCierre(e); break;
+    }
+}
+
+#ifndef SIN_GL
 // --- CALLBACKS GLFW ---
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
+    rViewport(width, height);
+}
+
+// Controles de la linea de tiempo: flechas = -/+ 1 s, Inicio = volver al
+// principio, Espacio = pausa. El salto lo aplica el loop principal.
+int pasoPedido = -1;
+int pausado = 0;
+int pasoActual();
+
+void key_callback(GLFWwindow* window, int key, int, int action, int) {
+    if (action != GLFW_PRESS && action != GLFW_REPEAT) return;
+    const int pasosPorSegundo = 1000 / PASO_MS;
+    int base = pasoPedido >= 0 ? pasoPedido : pasoActual();
+    if (key == GLFW_KEY_RIGHT) pasoPedido = base + pasosPorSegundo;
+    else if (key == GLFW_KEY_LEFT) pasoPedido = base > pasosPorSegundo ? base - pasosPorSegundo : 0;
+    else if (key == GLFW_KEY_HOME) pasoPedido = 0;
+    else if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) pausado = !pausado;
+    else if (key == GLFW_KEY_ESCAPE) glfwSetWindowShouldClose(window, 1);
 }
+#endif
 
 // --- LOGICA  ---
+// Un paso de la historia. Funcion pura: solo lee 'actual', el guion y las
+// velocidades de 'ajustes' (ninguno cambia durante un paso) y devuelve el
+// estado siguiente, asi se pueden simular muchas historias independientes.
+// Recargar el guion o las velocidades de 'ajustes' deja sin valor lo ya
+// calculado: invalidarHistoria vacia puntosControl.
+EstadoEscena avanzarEscena(const EstadoEscena& actual, int ms) {
+    ZONA_PERFIL("update");
+    const Guion& g = guion;
+    EstadoEscena e = actual;
+    e.timerGlobal += ms;
+    float t = (float)e.timerGlobal;
+    if (e.estado == INTRO) {
+        e.posPalomaX += e.dirPalomaX * ajustes.velPalomaIntro; e.posPalomaY += e.dirPalomaY * ajustes.velPalomaIntro;
+        e.numPisadas = guionAntes(g, PISTA_PISADAS, t);
+        if (guionAntes(g, PISTA_FIN_INTRO, t) > 0) e.estado = DESARROLLO;
+    }
+    else if (e.estado == DESARROLLO) {
+        e.anguloPierna = sin(e.timerGlobal * 0.005f) * 30.0f;
+        e.anguloBrazo = sin(e.timerGlobal * 0.005f) * 15.0f;
+        float destinoIzq = guionValor(g, PISTA_DESTINO_IZQ, t), destinoDer = guionValor(g, PISTA_DESTINO_DER, t);
+        if (e.posSolIzqX < destinoIzq) e.posSolIzqX += ajustes.velSoldadoIzq;
+        if (e.posSolDerX < destinoDer) e.posSolDerX += ajustes.velSoldadoDer;
+        if (e.posSolIzqX > guionValor(g, PISTA_POS_ARMA_IZQ, t) - 5) e.tieneArmaIzq = 1;
+        if (e.posSolDerX > guionValor(g, PISTA_POS_CASCO, t) - 5) e.tieneCasco = 1;
+        if (e.posSolDerX > guionValor(g, PISTA_POS_ARMA_DER, t) - 5) e.tieneArmaDer = 1;
+        if (e.posSolIzqX >= destinoIzq && e.posSolDerX >= destinoDer) {
+            e.estado = DISPAROS; e.timerDisparos = 0; e.contadorDisparos = 0; e.inicioDisparos = e.timerGlobal;
+        }
+    }
+    else if (e.estado == DISPAROS) {
+        e.timerDisparos += ms;
+        float td = (float)e.timerDisparos;
+        e.contadorDisparos = guionAntes(g, PISTA_DISPAROS, td);
+        e.esFogonazo = guionEventoEn(g, PISTA_DISPAROS, td) >= 0;
+        if (guionAntes(g, PISTA_FIN_DISPAROS, td) > 0) { e.estado = CIERRE; e.subEstado = FIN_ESPERA_PALOMA; e.timerFinal = 0; e.posPalomaX = -20.0f; e.posPalomaY = 60.0f; }
+    }
+    else if (e.estado == CIERRE) {
+        e.timerFinal += ms;
+        float tf = (float)e.timerFinal;
+        if (e.subEstado == FIN_ESPERA_PALOMA) {
+            e.posPalomaX += ajustes.velPalomaCierre; e.posPalomaY += sin(e.timerGlobal * 0.005f) * 0.1f;
+            if (e.posPalomaX > guionValor(g, PISTA_LLEGADA_PALOMA, tf)) { e.subEstado = FIN_MIRAR; e.timerFinal = 0; }
+        }
+        else if (e.subEstado == FIN_MIRAR) { if (guionAntes(g, PISTA_FIN_MIRAR, tf) > 0) { e.subEstado = FIN_SOLTAR; e.timerFinal = 0; } }
+        else if (e.subEstado == FIN_SOLTAR) { if (guionAntes(g, PISTA_FIN_SOLTAR, tf) > 0) e.subEstado = FIN_ABRAZO; }
+    }
+    return e;
+}
+
+// Avanza la historia global (o la multitud, que solo usa el reloj)
 void update(int ms) {
-    timerGlobal += ms;
-    if (estadoActual == INTRO) {
-        posPalomaX += dirPalomaX * 0.6f; posPalomaY += dirPalomaY * 0.6f;
-        if (timerGlobal > 800 * (numPisadasTotal + 1) && numPisadasTotal < 24) numPisadasTotal++;
-        if (timerGlobal > 20000) estadoActual = DESARROLLO;
-    }
-    else if (estadoActual == DESARROLLO) {
-        anguloPierna = sin(timerGlobal * 0.005f) * 30.0f;
-        anguloBrazo = sin(timerGlobal * 0.005f) * 15.0f;
-        if (posSolIzqX < 45.0f) posSolIzqX += 0.25f; if (posSolDerX < 65.0f) posSolDerX += 0.2f;
-        if (posSolIzqX > POS_ARMA_IZQ - 5) tieneArmaIzq = 1; if (posSolDerX > POS_CASCO - 5) tieneCasco = 1; if (posSolDerX > POS_ARMA_DER - 5) tieneArmaDer = 1;
-        if (posSolIzqX >= 45.0f && posSolDerX >= 65.0f) { estadoActual = DISPAROS; timerDisparos = 0; contadorDisparos = 0; }
-    }
-    else if (estadoActual == DISPAROS) {
-        timerDisparos += ms; esFogonazo = 0; 
-        if (timerDisparos > 500 && contadorDisparos == 0) { contadorDisparos++; } if (timerDisparos > 500 && timerDisparos < 600) esFogonazo = 1;
-        if (timerDisparos > 1500 && contadorDisparos == 1) { contadorDisparos++; } if (timerDisparos > 1500 && timerDisparos < 1600) esFogonazo = 1;
-        if (timerDisparos > 2500 && contadorDisparos == 2) { contadorDisparos++; } if (timerDisparos > 2500 && timerDisparos < 2600) esFogonazo = 1;
-        if (timerDisparos > 3500) { estadoActual = CIERRE; subEstadoActual = FIN_ESPERA_PALOMA; timerFinal = 0; posPalomaX = -20.0f; posPalomaY = 60.0f; }
-    }
-    else if (estadoActual == CIERRE) {
-        timerFinal += ms;
-        if (subEstadoActual == FIN_ESPERA_PALOMA) { posPalomaX += 0.5f; posPalomaY += sin(timerGlobal * 0.005f) * 0.1f; if (posPalomaX > 20.0f) { subEstadoActual = FIN_MIRAR; timerFinal = 0; } }
-        else if (subEstadoActual == FIN_MIRAR) { if (timerFinal > 2000) { subEstadoActual = FIN_SOLTAR; timerFinal = 0; } }
-        else if (subEstadoActual == FIN_SOLTAR) { if (timerFinal > 1000) subEstadoActual = FIN_ABRAZO; }
+    if (numMultitud > 0) { escena.timerGlobal += ms; actualizarMultitud(); return; }
+    escena = avanzarEscena(escena, ms);
+}
+
+// Vuelve la historia a su estado inicial (para encadenar corridas)
+void reiniciarHistoria() { escena = ESCENA_INICIAL; }
+
+// --- LINEA DE TIEMPO ---
+// avanzarEscena() integra el estado paso a paso, asi que para llegar al paso
+// N hay que simular los anteriores. Para saltar a cualquier momento se guarda
+// una copia del EstadoEscena cada PASOS_ENTRE_PUNTOS pasos: estadoEnPaso()
+// parte de la anterior y simula como mucho PASOS_ENTRE_PUNTOS - 1 pasos, un
+// costo fijo sin importar el destino.
+#define PASOS_ENTRE_PUNTOS 64
+
+std::vector<EstadoEscena> puntosControl;     // puntosControl[k]: estado tras k * PASOS_ENTRE_PUNTOS pasos
+
+int pasoActual() { return escena.timerGlobal / PASO_MS; }
+
+// Simula desde el ultimo punto de control hasta cubrir 'paso', guardando los
+// puntos nuevos. Se llama sola desde estadoEnPaso; la historia completa se
+// cubre en menos de un milisegundo.
+void extenderLineaDeTiempo(int paso) {
+    if (puntosControl.empty()) puntosControl.push_back(ESCENA_INICIAL);
+    while (paso >= (int)puntosControl.size() * PASOS_ENTRE_PUNTOS) {
+        EstadoEscena e = puntosControl.back();
+        for (int k = 0; k < PASOS_ENTRE_PUNTOS; k++) e = avanzarEscena(e, PASO_MS);
+        puntosControl.push_back(e);
     }
 }
 
-// --- MAIN ---
-int main() {
+// Estado exacto tras simular 'paso' pasos desde el inicio. Si los puntos de
+// control ya cubren 'paso' solo los lee, y se puede llamar desde varios hilos.
+EstadoEscena estadoEnPaso(int paso) {
+    if (paso < 0) paso = 0;
+    extenderLineaDeTiempo(paso);
+    EstadoEscena e = puntosControl[paso / PASOS_ENTRE_PUNTOS];
+    for (int k = paso % PASOS_ENTRE_PUNTOS; k > 0; k--) e = avanzarEscena(e, PASO_MS);
+    return e;
+}
+
+void irAPaso(int paso) { escena = estadoEnPaso(paso); }
+
+// --- PASO FIJO E INTERPOLACION ---
+// Solo lo que se mueve de forma continua se interpola entre el paso anterior
+// y el actual; se dibuja esa copia mezclada y la simulacion no se entera.
+// Si el paso cambio de escena (p.ej. la paloma reaparece en CIERRE) no se
+// interpola: se muestra directamente el estado nuevo
+EstadoEscena interpolarEscena(const EstadoEscena& a, const EstadoEscena& b, float alfa) {
+    if (a.estado != b.estado || a.subEstado != b.subEstado) return b;
+    EstadoEscena r = b;
+    r.posPalomaX = a.posPalomaX + (b.posPalomaX - a.posPalomaX) * alfa;
+    r.posPalomaY = a.posPalomaY + (b.posPalomaY - a.posPalomaY) * alfa;
+    r.posSolIzqX = a.posSolIzqX + (b.posSolIzqX - a.posSolIzqX) * alfa;
+    r.posSolDerX = a.posSolDerX + (b.posSolDerX - a.posSolDerX) * alfa;
+    r.anguloBrazo = a.anguloBrazo + (b.anguloBrazo - a.anguloBrazo) * alfa;
+    r.anguloPierna = a.anguloPierna + (b.anguloPierna - a.anguloPierna) * alfa;
+    return r;
+}
+
+// --- AJUSTES EN CALIENTE ---
+// --ajustes lee un archivo de texto con valores de Ajustes, uno por linea;
+// lo que no aparece queda como estaba:
+//   # comentario
+//   COL_ROJO = 0.8 0.25 0.15
+//   vel_soldado_izq = 0.3
+//   cabeza_der = 1.2
+// Con --vigilar la ventana vuelve a leer ese archivo, el guion (--guion) y la
+// textura de la paloma cada vez que se guardan. Se revisa entre frames en el
+// hilo que dibuja, asi lo nuevo entra entero antes del paso siguiente; un
+// archivo con errores se informa y no cambia nada.
+
+typedef struct { const char* nombre; size_t desplazamiento; } CampoAjuste;
+
+const CampoAjuste CAMPOS_AJUSTES[] = {
+    { "vel_soldado_izq",   offsetof(Ajustes, velSoldadoIzq) },
+    { "vel_soldado_der",   offsetof(Ajustes, velSoldadoDer) },
+    { "vel_paloma_intro",  offsetof(Ajustes, velPalomaIntro) },
+    { "vel_paloma_cierre", offsetof(Ajustes, velPalomaCierre) },
+    { "cabeza_izq",        offsetof(Ajustes, izq) + offsetof(ProporcionesSoldado, cabeza) },
+    { "torso_izq",         offsetof(Ajustes, izq) + offsetof(ProporcionesSoldado, torso) },
+    { "piernas_izq",       offsetof(Ajustes, izq) + offsetof(ProporcionesSoldado, piernas) },
+    { "cabeza_der",        offsetof(Ajustes, der) + offsetof(ProporcionesSoldado, cabeza) },
+    { "torso_der",         offsetof(Ajustes, der) + offsetof(ProporcionesSoldado, torso) },
+    { "piernas_der",       offsetof(Ajustes, der) + offsetof(ProporcionesSoldado, piernas) },
+};
+const int NUM_CAMPOS_AJUSTES = sizeof(CAMPOS_AJUSTES) / sizeof(CAMPOS_AJUSTES[0]);
+
+// Los ajustes en uso, con la paleta tal como esta
+Ajustes ajustesActuales() {
+    Ajustes a = ajustes;
+    for (int i = 0; i < COLORES_PALETA; i++) memcpy(a.colores[i], PALETA[i], sizeof(a.colores[i]));
+    return a;
+}
+
+// Aplica 'texto' sobre 'a'. Devuelve 0 y deja el motivo en 'error' si algo
+// no se entiende (entonces 'a' puede quedar a medias: usar una copia)
+int leerAjustes(const char* texto, Ajustes& a, char* error, size_t tamError) {
+    int linea = 0;
+    for (const char* p = texto; *p; ) {
+        const char* fin = strchr(p, '\n');
+        if (!fin) fin = p + strlen(p);
+        std::string s(p, fin);
+        p = *fin ? fin + 1 : fin;
+        linea++;
+        size_t hash = s.find('#');
+        if (hash != std::string::npos) s.resize(hash);
+        char nombre[64];
+        int leidos = 0;
+        if (sscanf(s.c_str(), " %63[^= \t\r] = %n", nombre, &leidos) == EOF) continue;   // linea vacia
+        if (leidos == 0) { snprintf(error, tamError, "linea %d: se esperaba 'nombre = valores'", linea); return 0; }
+        float* destino = NULL;
+        int componentes = 1;
+        for (int i = 0; i < COLORES_PALETA; i++)
+            if (strcmp(NOMBRES_COLOR[i], nombre) == 0) { destino = a.colores[i]; componentes = 3; }
+        for (int i = 0; i < NUM_CAMPOS_AJUSTES; i++)
+            if (strcmp(CAMPOS_AJUSTES[i].nombre, nombre) == 0) destino = (float*)((char*)&a + CAMPOS_AJUSTES[i].desplazamiento);
+        if (!destino) { snprintf(error, tamError, "linea %d: '%s' no es un ajuste", linea, nombre); return 0; }
+        const char* q = s.c_str() + leidos;
+        for (int k = 0; k < componentes; k++) {
+            char* r;
+            float v = strtof(q, &r);
+            if (r == q || !isfinite(v)) {
+                snprintf(error, tamError, "linea %d: %s lleva %d numero(s)", linea, nombre, componentes);
+                return 0;
+            }
+            destino[k] = v;
+            q = r;
+        }
+        while (*q == ' ' || *q == '\t' || *q == '\r') q++;
+        if (*q) { snprintf(error, tamError, "linea %d: sobra '%s'", linea, q); return 0; }
+    }
+    return 1;
+}
+
+int cargarAjustes(const char* ruta, Ajustes& a) {
+    std::vector<unsigned char> bytes;
+    if (!leerArchivo(ruta, bytes)) { printf(">> ERROR: no se pudo leer %s\n", ruta); return 0; }
+    bytes.push_back(0);
+    char error[256];
+    if (!leerAjustes((const char*)bytes.data(), a, error, sizeof(error))) {
+        printf(">> ERROR en los ajustes %s: %s\n", ruta, error);
+        return 0;
+    }
+    return 1;
+}
+
+// --volcar-ajustes: los valores en uso, en el formato de --ajustes
+int volcarAjustes(const char* ruta) {
+    FILE* f = fopen(ruta, "w");
+    if (!f) { printf(">> ERROR: no se pudo escribir %s\n", ruta); return -1; }
+    Ajustes a = ajustesActuales();
+    for (int i = 0; i < COLORES_PALETA; i++)
+        fprintf(f, "%s = %g %g %g\n", NOMBRES_COLOR[i], a.colores[i][0], a.colores[i][1], a.colores[i][2]);
+    for (int i = 0; i < NUM_CAMPOS_AJUSTES; i++)
+        fprintf(f, "%s = %g\n", CAMPOS_AJUSTES[i].nombre, *(const float*)((const char*)&a + CAMPOS_AJUSTES[i].desplazamiento));
+    int ok = !ferror(f);
+    fclose(f);
+    if (!ok) { printf(">> ERROR: no se pudo escribir %s\n", ruta); return -1; }
+    printf(">> Ajustes escritos en %s\n", ruta);
+    return 0;
+}
+
+// Lo que calculo avanzarEscena con el guion o las velocidades de antes ya no vale
+void invalidarHistoria() {
+    puntosControl.clear();
+    generacionHistoria++;
+}
+
+// Deja 'nuevo' en uso rehaciendo solo lo que depende de lo que cambio: la
+// paleta no rehace nada (las piezas apuntan a los arreglos), las velocidades
+// la linea de tiempo y cada juego de proporciones el rig de ese soldado.
+// Devuelve 1 si cambio la historia (hay que volver a calcular la escena).
+int aplicarAjustes(const Ajustes& nuevo) {
+    Ajustes viejo = ajustesActuales();
+    std::string cambios;
+    if (memcmp(viejo.colores, nuevo.colores, sizeof(nuevo.colores)) != 0) {
+        for (int i = 0; i < COLORES_PALETA; i++) memcpy(PALETA[i], nuevo.colores[i], sizeof(nuevo.colores[i]));
+        cambios += " paleta";
+    }
+    int historia = viejo.velSoldadoIzq != nuevo.velSoldadoIzq || viejo.velSoldadoDer != nuevo.velSoldadoDer ||
+                   viejo.velPalomaIntro != nuevo.velPalomaIntro || viejo.velPalomaCierre != nuevo.velPalomaCierre;
+    int izq = memcmp(&viejo.izq, &nuevo.izq, sizeof(nuevo.izq)) != 0;
+    int der = memcmp(&viejo.der, &nuevo.der, sizeof(nuevo.der)) != 0;
+    ajustes = nuevo;
+    if (historia) { invalidarHistoria(); cambios += " velocidades"; }
+    // antes de construirRigs (al arrancar) no hay nada que rehacer
+    int hayRigs = !rigSoldadoIzq.piezas.empty();
+    if (izq) { if (hayRigs) reconstruirSoldado(0); cambios += " soldado_izq"; }
+    if (der) { if (hayRigs) reconstruirSoldado(1); cambios += " soldado_der"; }
+    if (!cambios.empty()) printf(">> Ajustes aplicados:%s\n", cambios.c_str());
+    return historia;
+}
+
+Vigilancia vigilancia;
+const char* rutaAjustesVigilada = NULL;
+const char* rutaGuionVigilado = NULL;
+int vigAjustes = -1, vigGuion = -1, vigTextura = -1;
+int texturaPorRecargar = 0;
+
+void vigilarArchivos(const char* rutaAjustes, const char* rutaGuion) {
+    rutaAjustesVigilada = rutaAjustes;
+    rutaGuionVigilado = rutaGuion;
+    if (rutaAjustes) vigAjustes = vigAgregar(vigilancia, rutaAjustes);
+    if (rutaGuion) vigGuion = vigAgregar(vigilancia, rutaGuion);
+    if (imgPlumas >= 0) vigTextura = vigAgregar(vigilancia, recursos.recursos[imgPlumas].ruta.c_str());
+    printf(">> Vigilando %d archivo(s)\n", (int)vigilancia.rutas.size());
+}
+
+int cambio(uint32_t cambios, int indice) { return indice >= 0 && (cambios >> indice & 1u); }
+
+// Una vez por frame, entre frames. Devuelve 1 si cambio la historia
+int recargarCambios() {
+    ZONA_PERFIL("recargarCambios");
+    uint32_t cambios = vigCambios(vigilancia);
+    int historia = 0;
+    if (cambio(cambios, vigAjustes)) {
+        Ajustes nuevo = ajustesActuales();
+        if (cargarAjustes(rutaAjustesVigilada, nuevo)) historia |= aplicarAjustes(nuevo);
+    }
+    if (cambio(cambios, vigGuion)) {
+        Guion nuevo;   // si no sirve, se descarta y sigue el de antes
+        if (cargarGuion(rutaGuionVigilado, nuevo)) {
+            guionIntercambiar(guion, nuevo);
+            invalidarHistoria();
+            historia = 1;
+            printf(">> Guion %s recargado\n", rutaGuionVigilado);
+        }
+    }
+    if (cambio(cambios, vigTextura)) texturaPorRecargar = 1;
+    // si la textura todavia se esta cargando se reintenta en el frame siguiente
+    if (texturaPorRecargar && recRecargar(recursos, imgPlumas)) texturaPorRecargar = 0;
+    return historia;
+}
+
+// --- MODO HEADLESS ---
+// Corre la historia completa sin ventana a toda velocidad de CPU, dibujando
+// cada frame con el backend CPU en un framebuffer en memoria. Solo se guarda
+// el ultimo frame.
+int ejecutarHeadless(int frames, int corridas, int hilos, const char* salida, int desde) {
+    backendCPUIniciar(SCR_WIDTH, SCR_HEIGHT, hilos, 0);
+    backendActual = &backendCPU;
+    cargarTexturas();
+    construirMallas();
+    construirRigs();
+    printf(">> HEADLESS: %d corrida(s) de %d frames (%ux%u, %d hilo(s))\n",
+           corridas, frames, SCR_WIDTH, SCR_HEIGHT, poolNumHilos(poolRaster));
+
+    auto inicio = std::chrono::steady_clock::now();
+    for (int c = 0; c < corridas; c++) {
+        irAPaso(desde);
+        for (int f = 0; f < frames; f++) {
+            ZONA_PERFIL("frame");
+            update(PASO_MS);
+            rIniciarFrame(COL_FONDO);
+            dibujarEscena(escena);
+            rTerminarFrame();
+        }
+    }
+    double seg = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    double total = (double)frames * corridas;
+    printf(">> %.0f frames en %.3f s (%.1f fps, %.3f ms/frame)\n", total, seg, total / seg, seg * 1000.0 / total);
+    if (reusoDibujo)
+        printf(">> Reuso: %ld de %ld objetos repetidos, %ld de %ld tiles sin rasterizar\n", objetosRepetidos, objetosGrabados,
+               rasterCPU.tilesReusados, rasterCPU.tilesReusados + rasterCPU.tilesDibujados);
+
+    int res = 0;
+    if (salida) {
+        if (fbGuardarPPM(rasterCPU.fb, salida)) printf(">> Ultimo frame guardado en %s\n", salida);
+        else { printf(">> ERROR: no se pudo escribir %s\n", salida); res = -1; }
+    }
+    poolDetener(poolRaster);
+    return res;
+}
+
+// Multitud sin ventana: mide el tiempo de cada frame (update + render) contra
+// objetivoMs. Con n < 0 barre n = 1000, 2000, 4000... hasta pasarse del
+// objetivo e informa el mayor tamano que lo cumplio.
+int ejecutarMultitud(int n, int frames, int hilos, const char* salida) {
+    backendCPUIniciar(SCR_WIDTH, SCR_HEIGHT, hilos, 0);
+    backendActual = &backendCPU;
+    poolIniciar(poolMultitud, hilos <= 0 ? -1 : hilos - 1);
+    cargarTexturas();
+    construirMallas();
+    construirRigs();
+
+    int barrido = (n < 0), mejor = 0;
+    for (int cant = barrido ? 1000 : n; ; cant *= 2) {
+        iniciarMultitud(cant);
+        escena.timerGlobal = 0;
+        double suma = 0.0, peor = 0.0;
+        int sobre = 0;
+        for (int f = 0; f < frames; f++) {
+            ZONA_PERFIL("frame");
+            auto t0 = std::chrono::steady_clock::now();
+            update(PASO_MS);
+            rIniciarFrame(COL_FONDO);
+            dibujarEscena(escena);
+            rTerminarFrame();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            suma += ms;
+            if (ms > peor) peor = ms;
+            if (ms > objetivoMs) sobre++;
+        }
+        double media = suma / frames;
+        printf(">> %7d soldados: %.2f ms/frame (peor %.2f), %d de %d frames sobre %.1f ms\n",
+               cant, media, peor, sobre, frames, objetivoMs);
+        if (media <= objetivoMs) mejor = cant;
+        if (!barrido || media > objetivoMs || cant >= (1 << 22)) break;
+    }
+    if (barrido) printf(">> Mayor multitud dentro del objetivo de %.1f ms: %d soldados\n", objetivoMs, mejor);
+
+    int res = 0;
+    if (salida) {
+        if (fbGuardarPPM(rasterCPU.fb, salida)) printf(">> Ultimo frame guardado en %s\n", salida);
+        else { printf(">> ERROR: no se pudo escribir %s\n", salida); res = -1; }
+    }
+    poolDetener(poolMultitud);
+    poolDetener(poolRaster);
+    return res;
+}
+
+// Particulas sin ventana: fuentes a lo ancho del suelo que reponen cada frame
+// lo que murio, asi siempre hay n vivas repartidas entre los tres tipos. La
+// fisica y las matrices van en tandas por poolMultitud y cada tipo se dibuja
+// en un solo lote. Informa ms de simulacion y de dibujo por frame.
+int ejecutarParticulas(int n, int frames, int hilos, const char* salida) {
+    backendCPUIniciar(SCR_WIDTH, SCR_HEIGHT, hilos, 0);
+    backendActual = &backendCPU;
+    poolIniciar(poolMultitud, hilos <= 0 ? -1 : hilos - 1);
+    construirMallas();
+
+    const int FUENTES = 16;
+    PoolParticulas pools[TIPOS_PARTICULA];
+    int porTipo[TIPOS_PARTICULA];
+    for (int t = 0; t < TIPOS_PARTICULA; t++) {
+        porTipo[t] = n / TIPOS_PARTICULA + (t < n % TIPOS_PARTICULA);
+        partIniciar(pools[t], porTipo[t], FISICA_PARTICULAS[t]);
+    }
+    printf(">> PARTICULAS: %d vivas en %d fuentes (%d hilo(s))\n", n, FUENTES, poolNumHilos(poolMultitud));
+
+    std::vector<float> azar;
+    double sumaSim = 0.0, sumaDib = 0.0, peor = 0.0;
+    for (int f = 0; f < frames; f++) {
+        ZONA_PERFIL("frame");
+        auto t0 = std::chrono::steady_clock::now();
+        for (int t = 0; t < TIPOS_PARTICULA; t++) {
+            PoolParticulas& p = pools[t];
+            int nuevas = porTipo[t] - p.vivas;
+            azar.resize(4 * (size_t)nuevas);
+            azarLlenar(claveAzar(0, (uint32_t)f, AZAR_FUENTES + t), 0, azar.data(), 4 * nuevas);
+            for (int i = 0; i < nuevas; i++) {
+                const float* a = &azar[4 * (size_t)i];
+                float x = (i % FUENTES + 0.5f) * (100.0f / FUENTES);
+                float angulo = (float)PI * (0.35f + 0.3f * a[0]);
+                float vel = 30.0f + 40.0f * a[1];
+                partEmitir(p, x, 16.0f, cosf(angulo) * vel, sinf(angulo) * vel, 1.0f + 2.0f * a[2], 0.0f, 8.0f * (a[3] - 0.5f), 1.0f);
+            }
+            partAvanzar(p, PASO_MS / 1000.0f, &poolMultitud);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        rIniciarFrame(COL_FONDO);
+        partMatrices(pools[PART_CASQUILLO], 0.9f, 0.4f, 0.05f, 0, &poolMultitud);
+        colorRGB(COL_LATON);
+        rDibujarInstanciasMatriz(mallaRect, pools[PART_CASQUILLO].matrices.data(), pools[PART_CASQUILLO].vivas);
+        partMatrices(pools[PART_HUMO], 1.0f, 1.0f, 0.8f, 0, &poolMultitud);
+        colorRGBA(COL_HUMO, 0.35f);
+        rDibujarInstanciasMatriz(mallaOvalo[1], pools[PART_HUMO].matrices.data(), pools[PART_HUMO].vivas);
+        partMatrices(pools[PART_CHISPA], 1.2f, 0.15f, 1.0f, 1, &poolMultitud);
+        colorRGB(COL_FUEGO_INT);
+        rDibujarInstanciasMatriz(mallaRect, pools[PART_CHISPA].matrices.data(), pools[PART_CHISPA].vivas);
+        rTerminarFrame();
+        auto t2 = std::chrono::steady_clock::now();
+        double sim = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double dib = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        sumaSim += sim; sumaDib += dib;
+        if (sim + dib > peor) peor = sim + dib;
+    }
+    int vivas = 0;
+    for (int t = 0; t < TIPOS_PARTICULA; t++) vivas += pools[t].vivas;
+    printf(">> %7d particulas: simular %.2f ms + dibujar %.2f ms por frame (peor %.2f), %d vivas al final\n",
+           n, sumaSim / frames, sumaDib / frames, peor, vivas);
+
+    int res = 0;
+    if (salida) {
+        if (fbGuardarPPM(rasterCPU.fb, salida)) printf(">> Ultimo frame guardado en %s\n", salida);
+        else { printf(">> ERROR: no se pudo escribir %s\n", salida); res = -1; }
+    }
+    poolDetener(poolMultitud);
+    poolDetener(poolRaster);
+    return res;
+}
+
+// --- MODO SERVIDOR ---
+// Muchas historias independientes en un proceso. Una sesion es su
+// EstadoEscena mas su variante (paleta y velocidad): mallas, rigs, textura
+// y puntos de control se comparten solo lectura, y los framebuffers son de
+// los hilos del pool, no de las sesiones, asi cada sesion ocupa unos
+// cientos de bytes. En cada tick el pool se reparte las sesiones: el hilo
+// avanza la sesion los pasos que le tocan, la dibuja en su rasterizador y
+// entrega el frame (aca se resume en un hash; un servidor lo codificaria).
+typedef struct {
+    EstadoEscena estado;
+    FiltroColor paleta;
+    float velocidad;            // pasos de historia por tick
+    float pasosPendientes;
+    uint32_t hashFrame;         // FNV-1a del ultimo frame entregado
+} Sesion;
+static_assert(sizeof(Sesion) == 120, "cambio el tamano de una sesion: actualizar el README (modo servidor)");
+
+const FiltroColor PALETAS_SERVIDOR[] = {
+    { {1.00f, 1.00f, 1.00f}, {0.00f, 0.00f, 0.00f} },    // original
+    { {0.90f, 0.75f, 0.55f}, {0.08f, 0.05f, 0.00f} },    // sepia
+    { {0.75f, 0.85f, 1.05f}, {0.00f, 0.02f, 0.06f} },    // fria
+    { {0.45f, 0.50f, 0.70f}, {0.00f, 0.00f, 0.05f} },    // noche
+    { {1.10f, 0.90f, 0.75f}, {0.05f, 0.02f, 0.00f} },    // calida
+};
+const int NUM_PALETAS = sizeof(PALETAS_SERVIDOR) / sizeof(PALETAS_SERVIDOR[0]);
+
+std::vector<Sesion> sesiones;
+PoolHilos poolServidor;
+
+// Variantes deterministas: paleta, velocidad (0.5x a 2x), momento de inicio y semilla
+void iniciarSesiones(int n) {
+    extenderLineaDeTiempo(FRAMES_HISTORIA);    // compartidos: se arman antes de usar el pool
+    sesiones.resize(n);
+    for (int i = 0; i < n; i++) {
+        Sesion& s = sesiones[i];
+        s.estado = estadoEnPaso((i * 97) % FRAMES_HISTORIA);
+        s.estado.semilla = (uint32_t)i;
+        s.paleta = PALETAS_SERVIDOR[i % NUM_PALETAS];
+        s.velocidad = 0.5f + ((i * 7) % 16) * 0.1f;
+        s.pasosPendientes = 0.0f;
+        s.hashFrame = 0;
+    }
+}
+
+uint32_t hashFrame(const std::vector<uint32_t>& px) {
+    uint32_t h = 2166136261u;
+    for (uint32_t p : px) { h = (h ^ p) * 16777619u; }
+    return h;
+}
+
+// Un tick de una sesion, en el hilo del pool que la tomo
+void atenderSesion(Sesion& s, const char* dirSalida) {
+    ZONA_PERFIL("atenderSesion");
+    if (rasterCPU.fb.ancho == 0) rcCrear(rasterCPU, SCR_WIDTH, SCR_HEIGHT, NULL);
+    s.pasosPendientes += s.velocidad;
+    for (; s.pasosPendientes >= 1.0f; s.pasosPendientes -= 1.0f) s.estado = avanzarEscena(s.estado, PASO_MS);
+    if (s.estado.timerGlobal >= FRAMES_HISTORIA * PASO_MS) {   // vuelve a empezar, con su misma semilla
+        uint32_t semilla = s.estado.semilla;
+        s.estado = ESCENA_INICIAL;
+        s.estado.semilla = semilla;
+    }
+    rFiltroColor(s.paleta);
+    rIniciarFrame(COL_FONDO);
+    dibujarEscena(s.estado);
+    rTerminarFrame();
+    rFiltroColor(FILTRO_NEUTRO);
+    s.hashFrame = hashFrame(rasterCPU.fb.color);
+    if (dirSalida) {
+        char ruta[1024];
+        snprintf(ruta, sizeof(ruta), "%s/sesion%04d.ppm", dirSalida, (int)(&s - sesiones.data()));
+        if (!fbGuardarPPM(rasterCPU.fb, ruta)) printf(">> ERROR: no se pudo escribir %s\n", ruta);
+    }
+}
+
+// Corre 'ticks' ticks de n sesiones. Con dirSalida guarda el ultimo frame de cada una
+int ejecutarServidor(int n, int ticks, int hilos, const char* dirSalida) {
+    backendActual = &backendCPU;
+    poolIniciar(poolServidor, hilos <= 0 ? -1 : hilos - 1);
+    cargarTexturas();
+    construirMallas();
+    construirRigs();
+    iniciarSesiones(n);
+
+    size_t bytesTexturas = rMemoriaTexturas();
+    size_t bytesMallas = verticesMallas.size() * sizeof(VerticeRaster) + mallas.size() * sizeof(Malla);
+    size_t bytesRaster = (size_t)SCR_WIDTH * SCR_HEIGHT * (sizeof(uint32_t) + sizeof(float));
+    printf(">> SERVIDOR: %d sesiones, %d ticks, %d hilo(s)\n", n, ticks, poolNumHilos(poolServidor));
+    printf(">> Memoria: %zu bytes por sesion (%.1f KB las %d); compartido: texturas con mipmaps %.1f KB, mallas %.1f KB, "
+           "framebuffer %.1f KB por hilo\n", sizeof(Sesion), n * sizeof(Sesion) / 1024.0, n,
+           bytesTexturas / 1024.0, bytesMallas / 1024.0, bytesRaster / 1024.0);
+
+    double suma = 0.0, peor = 0.0;
+    for (int t = 0; t < ticks; t++) {
+        ZONA_PERFIL("tick");
+        const char* dir = (t == ticks - 1) ? dirSalida : NULL;
+        auto t0 = std::chrono::steady_clock::now();
+        poolParaCada(poolServidor, n, [dir](int i) { atenderSesion(sesiones[i], dir); });
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        suma += ms;
+        if (ms > peor) peor = ms;
+    }
+    double media = suma / ticks;
+    uint32_t hash = 2166136261u;
+    for (const Sesion& s : sesiones) hash = (hash ^ s.hashFrame) * 16777619u;
+    printf(">> %.2f ms/tick (peor %.2f): %.0f frames/s, %.1f sesiones sostenibles a %d ms por frame\n",
+           media, peor, n * 1000.0 / media, n * PASO_MS / media, PASO_MS);
+    printf(">> Hash de los ultimos frames: %08x\n", hash);
+    if (dirSalida) printf(">> Ultimo frame de cada sesion guardado en %s\n", dirSalida);
+    poolDetener(poolServidor);
+    return 0;
+}
+
+// --- IMAGENES DE REFERENCIA ---
+// Red de seguridad para refactors del dibujo: se renderizan momentos fijos de
+// cada estado de la historia con el backend CPU y se comparan contra PPMs de
+// referencia generados antes (p.ej. en el commit anterior al cambio).
+typedef struct { const char* nombre; int paso; } MomentoReferencia;
+
+const MomentoReferencia MOMENTOS_REFERENCIA[] = {
+    { "intro_paloma", 400 },             { "intro_pisadas", 1200 },
+    { "desarrollo_caminata", 1400 },     { "desarrollo_armados", 1700 },
+    { "disparos_apuntando", 1760 },      { "disparos_fogonazo", 1784 },
+    { "cierre_espera_paloma", 2010 },    { "cierre_mirar", 2100 },
+    { "cierre_soltar", 2200 },           { "cierre_abrazo", 2300 },
+};
+const int NUM_MOMENTOS = sizeof(MOMENTOS_REFERENCIA) / sizeof(MOMENTOS_REFERENCIA[0]);
+
+float toleranciaPixel = 6.0f;       // distancia de color (0..255) que no se considera cambio
+float toleranciaArea = 0.0001f;     // fraccion de pixeles distintos que se acepta (48 de 800x600)
+
+// Distancia RGB ponderada por la sensibilidad del ojo a cada canal (pesos de luma BT.601)
+float distanciaPerceptual(uint32_t a, uint32_t b) {
+    float dr = (float)(int)((a & 255) - (b & 255));
+    float dg = (float)(int)(((a >> 8) & 255) - ((b >> 8) & 255));
+    float db = (float)(int)(((a >> 16) & 255) - ((b >> 16) & 255));
+    return sqrtf(0.299f * dr * dr + 0.587f * dg * dg + 0.114f * db * db);
+}
+
+// Mapa de calor: la referencia en gris apagado y encima cada diferencia,
+// azul si queda dentro de la tolerancia y de rojo a amarillo segun su tamano
+// si la supera. Devuelve cuantos pixeles superan la tolerancia.
+int compararImagenes(const Framebuffer& ref, const Framebuffer& actual, Framebuffer& calor, float* peor) {
+    fbCrear(calor, ref.ancho, ref.alto);
+    int distintos = 0;
+    *peor = 0.0f;
+    for (size_t i = 0; i < ref.color.size(); i++) {
+        uint32_t r = ref.color[i];
+        float d = distanciaPerceptual(r, actual.color[i]);
+        if (d > *peor) *peor = d;
+        int gris = (int)(((r & 255) * 77 + ((r >> 8) & 255) * 150 + ((r >> 16) & 255) * 29) >> 8) / 3;
+        uint32_t c = gris | (gris << 8) | (gris << 16);
+        if (d > toleranciaPixel) {
+            distintos++;
+            int t = (int)std::min(255.0f, d * 4.0f);
+            c = 255 | (t << 8);
+        } else if (d > 0.0f) c = gris | (gris << 8) | (200u << 16);
+        calor.color[i] = c | 0xFF000000u;
+    }
+    return distintos;
+}
+
+// generar = 1 escribe las referencias en 'dir'; si no, compara contra ellas y
+// deja dir/<momento>_actual.ppm y dir/<momento>_diferencia.ppm de los que fallan
+int ejecutarReferencias(const char* dir, int generar, int hilos) {
+    backendCPUIniciar(SCR_WIDTH, SCR_HEIGHT, hilos, 0);
+    backendActual = &backendCPU;
+    cargarTexturas();
+    construirMallas();
+    construirRigs();
+    printf(">> %s %d imagenes de referencia en %s\n", generar ? "GENERANDO" : "COMPARANDO", NUM_MOMENTOS, dir);
+
+    int fallas = 0;
+    char ruta[1024];
+    for (int m = 0; m < NUM_MOMENTOS; m++) {
+        const MomentoReferencia& mom = MOMENTOS_REFERENCIA[m];
+        irAPaso(mom.paso);
+        rIniciarFrame(COL_FONDO);
+        dibujarEscena(escena);
+        rTerminarFrame();
+
+        snprintf(ruta, sizeof(ruta), "%s/%s.ppm", dir, mom.nombre);
+        if (generar) {
+            if (!fbGuardarPPM(rasterCPU.fb, ruta)) { printf(">> ERROR: no se pudo escribir %s\n", ruta); fallas++; }
+            continue;
+        }
+        Framebuffer ref, calor;
+        if (!fbCargarPPM(ref, ruta) || ref.ancho != rasterCPU.fb.ancho || ref.alto != rasterCPU.fb.alto) {
+            printf("   %-24s FALTA  (no se pudo leer %s)\n", mom.nombre, ruta);
+            fallas++;
+            continue;
+        }
+        float peor;
+        int distintos = compararImagenes(ref, rasterCPU.fb, calor, &peor);
+        float fraccion = (float)distintos / ref.color.size();
+        int ok = fraccion <= toleranciaArea;
+        printf("   %-24s %s  %7d px distintos (%.4f%%), peor distancia %.1f\n",
+               mom.nombre, ok ? "OK   " : "FALLA", distintos, fraccion * 100.0f, peor);
+        if (!ok) {
+            fallas++;
+            snprintf(ruta, sizeof(ruta), "%s/%s_actual.ppm", dir, mom.nombre);
+            fbGuardarPPM(rasterCPU.fb, ruta);
+            snprintf(ruta, sizeof(ruta), "%s/%s_diferencia.ppm", dir, mom.nombre);
+            fbGuardarPPM(calor, ruta);
+        }
+    }
+    if (!generar) printf(">> %d de %d momentos dentro de la tolerancia\n", NUM_MOMENTOS - fallas, NUM_MOMENTOS);
+    poolDetener(poolRaster);
+    return fallas ? 1 : 0;
+}
+
+#ifndef SIN_GL
+// Ventana con contexto GL 3.3 de compatibilidad y estado fijo de la escena.
+// Invisible para exportar (se dibuja en un FBO propio).
+GLFWwindow* crearVentana(int visible, int vsync) {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Proyecto Lebedev", NULL, NULL);
     if (window == NULL) {
         printf("Fallo al crear ventana GLFW\n");
         glfwTerminate();
-        return -1;
+        return NULL;
     }
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(vsync);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         printf("Fallo al inicializar GLAD\n");
-        return -1;
+        glfwTerminate();
+        return NULL;
     }
 
     glEnable(GL_BLEND); 
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_DEPTH_TEST);
-    cargarTextura();
+    return window;
+}
+#endif
 
-    // Loop Principal
-    while (!glfwWindowShouldClose(window)) {
-        double currentTime = glfwGetTime();
-        if (currentTime - lastTime >= 0.016) {
-            update(16);
-            lastTime = currentTime;
-
-            glClearColor(COL_FONDO[0], COL_FONDO[1], COL_FONDO[2], 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            glMatrixMode(GL_PROJECTION);
-            glLoadIdentity();
-            glOrtho(0.0, 100.0, 0.0, 100.0, -10.0, 10.0);
-            glMatrixMode(GL_MODELVIEW);
-            glLoadIdentity();
-
-            switch(estadoActual) {
-                case INTRO: dibujarIntro(); break;
-                case DESARROLLO: dibujarDesarrollo(); break;
-                case DISPAROS: dibujarDisparos(); break;
-                case CIERRE: dibujarCierre(); break;
+// --- EXPORTACION ---
+// Avanza la historia un paso fijo por frame y manda cada imagen al hilo
+// escritor (exportar.h). La salida dura exactamente frames * PASO_MS.
+// Con GL se lee de un FBO a traves de dos PBOs alternados, de modo que la
+// lectura del frame N se solapa con el dibujo del N+1.
+//
+// Con el backend CPU los frames se reparten entre hilos: cada uno tiene su
+// propio rasterizador (thread_local) y su propio EstadoEscena, al que llega
+// en el primer frame de cada tanda con estadoEnPaso, asi que no depende de
+// lo que dibujaron los demas. Las tandas se reparten
+// intercaladas; el hilo que vacia su cola roba la tanda pendiente mas
+// temprana de otro. Los frames terminan fuera de orden y un buffer de
+// reordenamiento se los pasa al escritor en orden, sin copias (intercambio
+// de buffers). Cada buffer viaja con el historial de tiles (rasterizador.h)
+// del frame que tiene, asi el hilo que lo recibe de vuelta reusa los tiles
+// que siguen valiendo sin haber copiado el frame anterior.
+#define FRAMES_POR_TANDA 4
+
+struct ColaTandas {
+    std::mutex mtx;
+    std::deque<int> tandas;         // indices de tanda, crecientes
+};
+
+// El frame f espera en ranuras[f % ventana] hasta que el escritor lo pida.
+// Solo se toma una tanda si todos sus frames caben en la ventana, asi un
+// frame terminado nunca espera ranura y la memoria queda acotada.
+struct Reordenador {
+    std::vector<std::vector<uint32_t>> ranuras;
+    std::vector<HistorialTiles> historiales;   // lo que tiene cada ranura
+    std::vector<char> lista;
+    int ventana = 0;
+    int siguiente = 0;              // proximo frame que se entrega al escritor
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+// Devuelve la proxima tanda para el hilo w, o -1 si no queda ninguna
+int tomarTanda(std::vector<ColaTandas>& colas, int w, Reordenador& ro, int frames) {
+    for (;;) {
+        int limite;
+        {
+            std::lock_guard<std::mutex> lock(ro.mtx);
+            limite = ro.siguiente + ro.ventana;
+        }
+        auto cabe = [&](int t) { return std::min(frames, (t + 1) * FRAMES_POR_TANDA) <= limite; };
+        {
+            std::lock_guard<std::mutex> lock(colas[w].mtx);
+            if (!colas[w].tandas.empty() && cabe(colas[w].tandas.front())) {
+                int t = colas[w].tandas.front();
+                colas[w].tandas.pop_front();
+                return t;
             }
+        }
+        // la propia no sirve: la tanda pendiente mas temprana de todas
+        int victima = -1, menor = 0;
+        for (int v = 0; v < (int)colas.size(); v++) {
+            std::lock_guard<std::mutex> lock(colas[v].mtx);
+            if (!colas[v].tandas.empty() && (victima < 0 || colas[v].tandas.front() < menor)) { victima = v; menor = colas[v].tandas.front(); }
+        }
+        if (victima < 0) return -1;
+        if (cabe(menor)) {
+            std::lock_guard<std::mutex> lock(colas[victima].mtx);
+            if (!colas[victima].tandas.empty() && colas[victima].tandas.front() == menor) {
+                colas[victima].tandas.pop_front();
+                return menor;
+            }
+            continue;               // otro hilo se la llevo antes
+        }
+        // todo lo pendiente queda fuera de la ventana: el frame 'siguiente'
+        // ya lo esta dibujando alguien, esperar a que el escritor avance
+        std::unique_lock<std::mutex> lock(ro.mtx);
+        ro.cv.wait(lock, [&] { return ro.siguiente + ro.ventana != limite; });
+    }
+}
 
+void trabajadorExportacion(std::vector<ColaTandas>* colas, int w, Reordenador* ro, int frames, int desde) {
+    rcCrear(rasterCPU, SCR_WIDTH, SCR_HEIGHT, NULL);   // un hilo por frame: sin pool propio
+    EstadoEscena e;                                    // la historia de este hilo
+    int paso = -1;                                     // paso en el que quedo 'e'
+    int t;
+    while ((t = tomarTanda(*colas, w, *ro, frames)) >= 0) {
+        int primero = t * FRAMES_POR_TANDA;
+        int fin = std::min(frames, primero + FRAMES_POR_TANDA);
+        if (paso != desde + primero) e = estadoEnPaso(desde + primero);
+        for (int f = primero; f < fin; f++) {
+            ZONA_PERFIL("frame");
+            e = avanzarEscena(e, PASO_MS);
+            rIniciarFrame(COL_FONDO);
+            dibujarEscena(e);
+            rTerminarFrame();
+            // el frame sale intercambiando buffers; el que queda en el
+            // rasterizador trae su historial, que dice que tiles reusar
+            int r = f % ro->ventana;
+            rasterCPU.fb.color.swap(ro->ranuras[r]);
+            std::swap(rasterCPU.previo, ro->historiales[r]);
+            std::lock_guard<std::mutex> lock(ro->mtx);
+            ro->lista[f % ro->ventana] = 1;
+            ro->cv.notify_all();
+        }
+        paso = desde + fin;
+    }
+}
+
+// Renderiza con 'hilos' hilos (<= 0: uno por nucleo) y entrega en orden
+void exportarEnParalelo(Exportador& exp, int frames, int hilos, int desde) {
+    int numHilos = hilos > 0 ? hilos : std::max(1, (int)std::thread::hardware_concurrency());
+    int numTandas = (frames + FRAMES_POR_TANDA - 1) / FRAMES_POR_TANDA;
+    std::vector<ColaTandas> colas(numHilos);
+    for (int t = 0; t < numTandas; t++) colas[t % numHilos].tandas.push_back(t);
+
+    Reordenador ro;
+    ro.ventana = 2 * numHilos * FRAMES_POR_TANDA;
+    ro.ranuras.assign(ro.ventana, std::vector<uint32_t>((size_t)SCR_WIDTH * SCR_HEIGHT));
+    ro.historiales.resize(ro.ventana);
+    ro.lista.assign(ro.ventana, 0);
+    std::vector<HistorialTiles> historialesExp(exp.buffers.size());   // los de los buffers del escritor
+
+    // los puntos de control se comparten: se arman antes de lanzar los hilos
+    extenderLineaDeTiempo(desde + frames);
+
+    std::vector<std::thread> trabajadores;
+    for (int w = 0; w < numHilos; w++) trabajadores.emplace_back(trabajadorExportacion, &colas, w, &ro, frames, desde);
+    for (int f = 0; f < frames; f++) {
+        int idx = expPedirBuffer(exp);
+        {
+            std::unique_lock<std::mutex> lock(ro.mtx);
+            ro.cv.wait(lock, [&] { return ro.lista[f % ro.ventana] != 0; });
+            exp.buffers[idx].swap(ro.ranuras[f % ro.ventana]);
+            std::swap(historialesExp[idx], ro.historiales[f % ro.ventana]);
+            ro.lista[f % ro.ventana] = 0;
+            ro.siguiente++;
+        }
+        ro.cv.notify_all();
+        expEnviar(exp, idx);
+    }
+    for (std::thread& t : trabajadores) t.join();
+}
+
+int ejecutarExportacion(const char* ruta, int frames, int hilos, int usarGL, int desde) {
+    Exportador exp;
+    if (!expAbrir(exp, ruta, SCR_WIDTH, SCR_HEIGHT, 1000, PASO_MS, 4)) return -1;
+
+#ifndef SIN_GL
+    GLFWwindow* window = NULL;
+    GLuint fbo = 0, rbColor = 0, rbProf = 0, pbos[2] = {0, 0};
+    if (usarGL) {
+        window = crearVentana(0, 0);
+        if (!window) { expCerrar(exp); return -1; }
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glGenRenderbuffers(1, &rbColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbColor);
+        glGenRenderbuffers(1, &rbProf);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbProf);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbProf);
+        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        glGenBuffers(2, pbos);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, SCR_WIDTH * SCR_HEIGHT * 4, NULL, GL_STREAM_READ);
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        backendActual = &backendGL;
+    }
+#else
+    if (usarGL) { printf(">> ERROR: compilado con SIN_GL, solo hay backend CPU\n"); expCerrar(exp); return -1; }
+#endif
+    if (!usarGL) backendActual = &backendCPU;   // cada hilo de exportarEnParalelo crea su rasterizador
+    cargarTexturas();
+    construirMallas();
+    construirRigs();
+    printf(">> EXPORTANDO %d frames a %s (backend %s)\n", frames, ruta, backendActual->nombre);
+
+#ifndef SIN_GL
+    auto recogerPBO = [&](GLuint pbo) {
+        ZONA_PERFIL("recogerPBO");
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        const void* px = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        int idx = expPedirBuffer(exp);
+        if (px) memcpy(exp.buffers[idx].data(), px, (size_t)SCR_WIDTH * SCR_HEIGHT * 4);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        expEnviar(exp, idx);
+    };
+#endif
+
+    auto inicio = std::chrono::steady_clock::now();
+    if (!usarGL) exportarEnParalelo(exp, frames, hilos, desde);
+#ifndef SIN_GL
+    else {
+        irAPaso(desde);
+        for (int f = 0; f < frames; f++) {
+            ZONA_PERFIL("frame");
+            update(PASO_MS);
+            rIniciarFrame(COL_FONDO);
+            dibujarEscena(escena);
+            rTerminarFrame();
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[f % 2]);
+            glReadPixels(0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+            // el frame actual se recoge en la vuelta siguiente; el ultimo, ya mismo
+            if (f > 0) recogerPBO(pbos[(f - 1) % 2]);
+            if (f == frames - 1) recogerPBO(pbos[f % 2]);
+        }
+    }
+#endif
+    double segRender = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    int ok = expCerrar(exp);
+    double seg = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    double duracion = frames * PASO_MS / 1000.0;
+    printf(">> %d frames (%.1f s de historia) en %.2f s (render %.2f s): %.1fx tiempo real\n",
+           exp.escritos, duracion, seg, segRender, duracion / seg);
+
+#ifndef SIN_GL
+    if (usarGL) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(2, pbos);
+        glDeleteRenderbuffers(1, &rbColor);
+        glDeleteRenderbuffers(1, &rbProf);
+        glDeleteFramebuffers(1, &fbo);
+        glfwTerminate();
+    }
+#endif
+    if (!ok) { printf(">> ERROR: fallo la escritura de %s\n", ruta); return -1; }
+    return 0;
+}
+
+// --- PERFIL ---
+const char* rutaTraza = NULL;
+
+// Se registra con atexit, asi cubre todas las salidas de main
+void perfilAlSalir() {
+    perfilInforme();
+    rInformeTexturas();
+    if (rutaTraza) {
+        if (perfilGuardarTraza(rutaTraza)) printf(">> Traza guardada en %s\n", rutaTraza);
+        else printf(">> ERROR: no se pudo escribir %s\n", rutaTraza);
+    }
+}
+
+// --- MAIN ---
+// bench_escena.cpp incluye este archivo con LEBEDEV_SIN_MAIN para usar la escena sin el programa
+#ifndef LEBEDEV_SIN_MAIN
+int main(int argc, char** argv) {
+    int headless = 0, frames = FRAMES_HISTORIA, corridas = 1, hilos = 0, usarCPU = 0, fpsMax = 60, vsync = 1;
+    int backendPedido = -1;   // -1 = por defecto, 0 = cpu, 1 = gl
+    const char* salida = NULL;
+    const char* exportar = NULL;
+    int multitudPedida = 0, framesDados = 0, desde = 0, sesionesPedidas = 0, particulasPedidas = 0;
+    const char* traza = NULL;
+    const char* dirReferencias = NULL;
+    const char* rutaGuion = NULL;
+    const char* rutaAjustes = NULL;
+    const char* volcar = NULL;
+    int generarReferencias = 0, vigilar = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) headless = 1;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) { frames = atoi(argv[++i]); framesDados = 1; }
+        else if (strcmp(argv[i], "--corridas") == 0 && i + 1 < argc) corridas = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hilos") == 0 && i + 1 < argc) hilos = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--salida") == 0 && i + 1 < argc) salida = argv[++i];
+        else if (strcmp(argv[i], "--exportar") == 0 && i + 1 < argc) exportar = argv[++i];
+        else if (strcmp(argv[i], "--desde") == 0 && i + 1 < argc) desde = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            i++;
+            backendPedido = (strcmp(argv[i], "gl") == 0) ? 1 : 0;
+            usarCPU = !backendPedido;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) fpsMax = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sin-vsync") == 0) vsync = 0;
+        else if (strcmp(argv[i], "--sin-reuso") == 0) reusoDibujo = 0;
+        else if (strcmp(argv[i], "--multitud") == 0 && i + 1 < argc) {
+            i++;
+            multitudPedida = (strcmp(argv[i], "auto") == 0) ? -1 : atoi(argv[i]);
+        }
+        else if (strcmp(argv[i], "--particulas") == 0 && i + 1 < argc) particulasPedidas = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hornear") == 0 && i + 2 < argc) { i += 2; return hornearTextura(argv[i - 1], argv[i]); }
+        else if (strcmp(argv[i], "--guion") == 0 && i + 1 < argc) rutaGuion = argv[++i];
+        else if (strcmp(argv[i], "--compilar-guion") == 0 && i + 2 < argc) { i += 2; return compilarGuion(argv[i - 1], argv[i]); }
+        else if (strcmp(argv[i], "--ajustes") == 0 && i + 1 < argc) rutaAjustes = argv[++i];
+        else if (strcmp(argv[i], "--volcar-ajustes") == 0 && i + 1 < argc) volcar = argv[++i];
+        else if (strcmp(argv[i], "--vigilar") == 0) vigilar = 1;
+        else if (strcmp(argv[i], "--servidor") == 0 && i + 1 < argc) sesionesPedidas = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--referencias-generar") == 0 && i + 1 < argc) { dirReferencias = argv[++i]; generarReferencias = 1; }
+        else if (strcmp(argv[i], "--referencias-comparar") == 0 && i + 1 < argc) dirReferencias = argv[++i];
+        else if (strcmp(argv[i], "--tolerancia") == 0 && i + 2 < argc) {
+            toleranciaPixel = (float)atof(argv[++i]);
+            toleranciaArea = (float)atof(argv[++i]) / 100.0f;
+        }
+        else if (strcmp(argv[i], "--perfil") == 0) perfilActivo = true;
+        else if (strcmp(argv[i], "--traza") == 0 && i + 1 < argc) { traza = argv[++i]; perfilActivo = true; }
+        else if (strcmp(argv[i], "--objetivo-ms") == 0 && i + 1 < argc) objetivoMs = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--ovalos") == 0 && i + 1 < argc) {
+            int lados = atoi(argv[++i]);   // "auto" -> 0
+            nivelOvaloFijo = -1;
+            for (int n = 0; n < NIVELES_OVALO; n++) if (LADOS_OVALO[n] == lados) nivelOvaloFijo = n;
+        }
+        else {
+            printf("Uso: %s [--backend gl|cpu] [--hilos N] [--ovalos auto|8|16|24|64] [--fps N] [--sin-vsync] [--sin-reuso] [--multitud N|auto] [--particulas N] [--objetivo-ms T] [--servidor SESIONES] [--hornear imagen.jpg imagen.ltex] [--guion historia.lgui] [--compilar-guion historia.txt|base historia.lgui] [--ajustes ajustes.txt] [--volcar-ajustes ajustes.txt] [--vigilar] [--perfil] [--traza perfil.json] [--referencias-generar DIR | --referencias-comparar DIR [--tolerancia DIST PORCENTAJE]] [--headless] [--desde PASO] [--frames N] [--corridas N] [--salida frame.ppm] [--exportar video.y4m|frames/f%%05d.png]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (perfilActivo) {
+        rutaTraza = traza;
+        atexit(perfilAlSalir);
+    }
+    iniciarGuion(rutaGuion);
+    if (rutaAjustes) {
+        Ajustes a = ajustesActuales();
+        if (!cargarAjustes(rutaAjustes, a)) return -1;
+        aplicarAjustes(a);
+    }
+    if (volcar) return volcarAjustes(volcar);
+#ifdef SIN_GL
+    headless = 1;
+    (void)usarCPU; (void)fpsMax; (void)vsync; (void)vigilar;
+#endif
+    if (sesionesPedidas > 0) return ejecutarServidor(sesionesPedidas, framesDados ? frames : 120, hilos, salida);
+    if (dirReferencias) return ejecutarReferencias(dirReferencias, generarReferencias, hilos);
+    // Exportar usa el backend CPU salvo que se pida --backend gl
+    if (exportar) return ejecutarExportacion(exportar, frames, hilos, backendPedido == 1, desde);
+    if (particulasPedidas > 0) return ejecutarParticulas(particulasPedidas, framesDados ? frames : 120, hilos, salida);
+    if (headless && multitudPedida != 0) return ejecutarMultitud(multitudPedida, framesDados ? frames : 120, hilos, salida);
+    if (headless) return ejecutarHeadless(frames, corridas, hilos, salida, desde);
+
+#ifndef SIN_GL
+    GLFWwindow* window = crearVentana(1, vsync);
+    if (!window) return -1;
+
+    if (usarCPU) {
+        backendCPUIniciar(SCR_WIDTH, SCR_HEIGHT, hilos, 1);
+        backendActual = &backendCPU;
+    } else {
+        backendActual = &backendGL;
+    }
+    printf(">> Backend de render: %s\n", backendActual->nombre);
+    pedirTexturas();   // no espera: la primera imagen sale sin la textura si aun no se decodifico
+    construirMallas();
+    construirRigs();
+    if (multitudPedida != 0) {
+        poolIniciar(poolMultitud, hilos <= 0 ? -1 : hilos - 1);
+        if (multitudPedida < 0) { printf(">> --multitud auto solo barre en --headless; se usan 10000\n"); multitudPedida = 10000; }
+        iniciarMultitud(multitudPedida);
+    }
+    if (desde > 0) irAPaso(desde);
+    if (vigilar) vigilarArchivos(rutaAjustes, rutaGuion);
+    double inicioMedicion = glfwGetTime(), msFrames = 0.0;
+    int framesMedidos = 0;
+
+    // Loop Principal: acumulador de paso fijo. Se simulan los pasos que
+    // correspondan al tiempo real transcurrido y se dibuja una vez,
+    // interpolando entre los dos ultimos pasos. Entre frames el hilo duerme
+    // esperando eventos (y el vsync bloquea en el swap).
+    const double pasoSeg = PASO_MS / 1000.0;
+    const double periodoFrame = fpsMax > 0 ? 1.0 / fpsMax : 0.0;
+    double anterior = glfwGetTime(), acumulador = 0.0, proximoFrame = anterior;
+    EstadoEscena previo = escena;
+    while (!glfwWindowShouldClose(window)) {
+        ZonaPerfil zonaFrame("frame");
+        double ahora = glfwGetTime();
+        double dt = ahora - anterior;
+        anterior = ahora;
+        if (dt > 0.25) dt = 0.25;   // tras una pausa larga no se intenta recuperar todo de golpe
+        // con la historia cambiada se recalcula el paso en que se estaba
+        if (vigilar && recargarCambios() && pasoPedido < 0) pasoPedido = pasoActual();
+        if (pasoPedido >= 0 && numMultitud == 0) {
+            irAPaso(pasoPedido);
+            printf(">> Paso %d (%.2f s)\n", pasoActual(), pasoActual() * pasoSeg);
+            previo = escena;
+            acumulador = 0.0;
+        }
+        pasoPedido = -1;
+        if (pausado) dt = 0.0;
+        acumulador += dt;
+        while (acumulador >= pasoSeg) {
+            previo = escena;
+            update(PASO_MS);
+            acumulador -= pasoSeg;
+        }
+
+        recSubirListas(recursos);
+        rIniciarFrame(COL_FONDO);
+        dibujarEscena(interpolarEscena(previo, escena, (float)(acumulador / pasoSeg)));
+        rTerminarFrame();
+        {
+            ZONA_PERFIL("glfwSwapBuffers");
             glfwSwapBuffers(window);
-            glfwPollEvents();
         }
+
+        // En modo multitud se informa una vez por segundo el costo medio de
+        // simular y dibujar (sin la espera del limitador)
+        if (numMultitud > 0) {
+            msFrames += (glfwGetTime() - ahora) * 1000.0;
+            framesMedidos++;
+            if (glfwGetTime() - inicioMedicion >= 1.0) {
+                printf(">> %d soldados: %.2f ms/frame (objetivo %.1f ms)\n", numMultitud, msFrames / framesMedidos, objetivoMs);
+                inicioMedicion = glfwGetTime(); msFrames = 0.0; framesMedidos = 0;
+            }
+        }
+
+        // Limitador: dormir hasta el siguiente frame; el ultimo milisegundo se
+        // cede con yield porque el timeout del sistema no es tan preciso
+        proximoFrame += periodoFrame;
+        if (proximoFrame < glfwGetTime()) proximoFrame = glfwGetTime();
+        for (;;) {
+            double resta = proximoFrame - glfwGetTime();
+            if (resta <= 0.0) break;
+            if (resta > 0.002) glfwWaitEventsTimeout(resta - 0.001);
+            else std::this_thread::yield();
+        }
+        glfwPollEvents();
     }
 
+    if (usarCPU) poolDetener(poolRaster);
+    poolDetener(poolMultitud);
     glfwTerminate();
+#endif
     return 0;
 }
+#endif
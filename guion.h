@@ -0,0 +1,240 @@
+// guion.h - Linea de tiempo de la historia como datos (.lgui)
+//
+// Un guion es un conjunto de pistas identificadas por numero. Cada pista
+// tiene claves ordenadas por tiempo (ms) y es de uno de dos tipos:
+//   valor    se interpola linealmente entre claves (antes de la primera y
+//            despues de la ultima vale lo que esas claves)
+//   eventos  cada clave es un evento que empieza en t y dura 'valor' ms
+// El reloj con que se consulta cada pista lo decide quien la usa.
+//
+// Se escribe en texto, una pista por linea (repetir el nombre agrega claves):
+//   # comentario
+//   eventos disparos 500:100 1500:100 2500:100
+//   valor pos_casco 0:35
+// y se compila a un binario plano que se mapea en memoria tal cual: cabecera,
+// tabla de pistas y todas las claves seguidas. Consultar una pista es una
+// busqueda binaria en sus claves, sin asignar memoria ni tocar otras pistas.
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "textura_horneada.h"      // mapearArchivo
+
+#define LGUI_VERSION 1
+#define GUION_MAX_PISTAS 64
+
+typedef enum { PISTA_VALOR = 0, PISTA_EVENTOS = 1 } TipoPista;
+
+// Todo en little endian; los desplazamientos son bytes desde el principio
+typedef struct {
+    char magia[4];                 // "LGUI"
+    uint32_t version;
+    uint32_t numPistas, numClaves;
+    uint32_t desplazamientoPistas, desplazamientoClaves;
+} CabeceraLgui;
+
+typedef struct { uint32_t id, tipo, primera, cantidad; } PistaGuion;
+typedef struct { float t, valor; } ClaveGuion;
+
+// Apunta dentro del archivo mapeado o de 'memoria'; no se copia
+struct Guion {
+    ArchivoMapeado archivo;
+    std::vector<unsigned char> memoria;
+    const PistaGuion* pistas = nullptr;
+    const ClaveGuion* claves = nullptr;
+    int indice[GUION_MAX_PISTAS];  // id -> posicion en pistas, -1 si no esta
+
+    Guion() { for (int i = 0; i < GUION_MAX_PISTAS; i++) indice[i] = -1; }
+    ~Guion() { desmapearArchivo(archivo); }
+    Guion(const Guion&) = delete;
+    Guion& operator=(const Guion&) = delete;
+};
+
+// Comprueba cabecera, limites, tipos, ids, que tiempos y valores sean finitos
+// (un inf o NaN llegaria como vertice al rasterizador) y el orden de las
+// claves, y arma el indice
+inline int guionValidar(Guion& g, const unsigned char* datos, size_t tamano) {
+    if (tamano < sizeof(CabeceraLgui)) return 0;
+    const CabeceraLgui* c = (const CabeceraLgui*)datos;
+    if (memcmp(c->magia, "LGUI", 4) != 0 || c->version != LGUI_VERSION) return 0;
+    if (c->numPistas > GUION_MAX_PISTAS || c->desplazamientoPistas % 4 || c->desplazamientoClaves % 4) return 0;
+    if ((uint64_t)c->desplazamientoPistas + (uint64_t)c->numPistas * sizeof(PistaGuion) > tamano) return 0;
+    if ((uint64_t)c->desplazamientoClaves + (uint64_t)c->numClaves * sizeof(ClaveGuion) > tamano) return 0;
+    const PistaGuion* pistas = (const PistaGuion*)(datos + c->desplazamientoPistas);
+    const ClaveGuion* claves = (const ClaveGuion*)(datos + c->desplazamientoClaves);
+    int indice[GUION_MAX_PISTAS];
+    for (int i = 0; i < GUION_MAX_PISTAS; i++) indice[i] = -1;
+    for (uint32_t p = 0; p < c->numPistas; p++) {
+        const PistaGuion& pista = pistas[p];
+        if (pista.id >= GUION_MAX_PISTAS || indice[pista.id] >= 0 || pista.tipo > PISTA_EVENTOS) return 0;
+        if (pista.cantidad == 0 || (uint64_t)pista.primera + pista.cantidad > c->numClaves) return 0;
+        for (uint32_t k = pista.primera; k < pista.primera + pista.cantidad; k++) {
+            if (!isfinite(claves[k].t) || !isfinite(claves[k].valor)) return 0;
+            if (k > pista.primera && !(claves[k - 1].t <= claves[k].t)) return 0;
+        }
+        indice[pista.id] = (int)p;
+    }
+    g.pistas = pistas; g.claves = claves;
+    memcpy(g.indice, indice, sizeof(indice));
+    return 1;
+}
+
+inline void guionCerrar(Guion& g) {
+    desmapearArchivo(g.archivo);
+    g.memoria.clear();
+    g.pistas = nullptr; g.claves = nullptr;
+    for (int i = 0; i < GUION_MAX_PISTAS; i++) g.indice[i] = -1;
+}
+
+inline int guionAbrir(const char* ruta, Guion& g) {
+    guionCerrar(g);
+    if (!mapearArchivo(ruta, g.archivo)) return 0;
+    if (guionValidar(g, g.archivo.datos, g.archivo.tamano)) return 1;
+    guionCerrar(g);
+    return 0;
+}
+
+// Toma un .lgui ya armado en memoria (p.ej. el que devuelve guionCompilar)
+inline int guionDesdeMemoria(std::vector<unsigned char>&& datos, Guion& g) {
+    guionCerrar(g);
+    g.memoria = std::move(datos);
+    if (guionValidar(g, g.memoria.data(), g.memoria.size())) return 1;
+    guionCerrar(g);
+    return 0;
+}
+
+// Cambia un guion por otro sin copiar claves: los punteros siguen validos
+// porque apuntan al mapeo o al buffer del vector, que se intercambian enteros
+inline void guionIntercambiar(Guion& a, Guion& b) {
+    std::swap(a.archivo, b.archivo);
+    a.memoria.swap(b.memoria);
+    std::swap(a.pistas, b.pistas);
+    std::swap(a.claves, b.claves);
+    std::swap(a.indice, b.indice);
+}
+
+inline const PistaGuion* guionPista(const Guion& g, int id) {
+    if (id < 0 || id >= GUION_MAX_PISTAS || g.indice[id] < 0) return NULL;
+    return &g.pistas[g.indice[id]];
+}
+
+// Claves de la pista con t estrictamente menor que 't' (0 si no existe)
+inline int guionAntes(const Guion& g, int id, float t) {
+    const PistaGuion* p = guionPista(g, id);
+    if (!p) return 0;
+    const ClaveGuion* ini = g.claves + p->primera;
+    return (int)(std::lower_bound(ini, ini + p->cantidad, t,
+                                  [](const ClaveGuion& c, float x) { return c.t < x; }) - ini);
+}
+
+inline const ClaveGuion* guionClave(const Guion& g, int id, int k) {
+    const PistaGuion* p = guionPista(g, id);
+    return (p && k >= 0 && k < (int)p->cantidad) ? &g.claves[p->primera + k] : NULL;
+}
+
+// Pista de valores en 't' (0 si no existe)
+inline float guionValor(const Guion& g, int id, float t) {
+    const PistaGuion* p = guionPista(g, id);
+    if (!p) return 0.0f;
+    const ClaveGuion* c = g.claves + p->primera;
+    int k = guionAntes(g, id, t);
+    if (k == 0) return c[0].valor;
+    if (k == (int)p->cantidad) return c[k - 1].valor;
+    const ClaveGuion& a = c[k - 1];
+    const ClaveGuion& b = c[k];
+    return a.valor + (b.valor - a.valor) * (t - a.t) / (b.t - a.t);
+}
+
+// Evento de la pista en curso en 't' (empezo antes y no termino), o -1.
+// Si los eventos se pisan cuenta solo el ultimo que empezo.
+inline int guionEventoEn(const Guion& g, int id, float t) {
+    int k = guionAntes(g, id, t) - 1;
+    const ClaveGuion* c = guionClave(g, id, k);
+    return (c && t < c->t + c->valor) ? k : -1;
+}
+
+// Texto -> .lgui. 'nombres[id]' es el nombre de la pista 'id' en el texto.
+// Devuelve 0 y deja el motivo en 'error' si algo no se entiende.
+inline int guionCompilar(const char* texto, const char* const* nombres, int numNombres,
+                         std::vector<unsigned char>& salida, char* error, size_t tamError) {
+    struct PistaTexto { int tipo = -1; std::vector<ClaveGuion> claves; };
+    std::vector<PistaTexto> pistas(numNombres);
+    int linea = 0;
+    for (const char* p = texto; *p; ) {
+        const char* fin = strchr(p, '\n');
+        if (!fin) fin = p + strlen(p);
+        std::string s(p, fin);
+        p = *fin ? fin + 1 : fin;
+        linea++;
+        size_t hash = s.find('#');
+        if (hash != std::string::npos) s.resize(hash);
+        char tipo[16], nombre[64];
+        int leidos = 0;
+        int campos = sscanf(s.c_str(), " %15s %63s %n", tipo, nombre, &leidos);
+        if (campos <= 0) continue;   // linea vacia
+        if (campos == 1) { snprintf(error, tamError, "linea %d: falta el nombre de la pista", linea); return 0; }
+        int t = strcmp(tipo, "valor") == 0 ? PISTA_VALOR : strcmp(tipo, "eventos") == 0 ? PISTA_EVENTOS : -1;
+        int id = -1;
+        for (int i = 0; i < numNombres; i++) if (nombres[i] && strcmp(nombres[i], nombre) == 0) id = i;
+        if (t < 0 || id < 0 || (pistas[id].tipo >= 0 && pistas[id].tipo != t)) {
+            snprintf(error, tamError, "linea %d: pista '%s %s' desconocida o de otro tipo", linea, tipo, nombre);
+            return 0;
+        }
+        pistas[id].tipo = t;
+        for (const char* q = s.c_str() + leidos; *q; ) {
+            char* r;
+            ClaveGuion c = { strtof(q, &r), 0.0f };
+            if (r == q) { snprintf(error, tamError, "linea %d: se esperaba un tiempo en '%s'", linea, q); return 0; }
+            if (!isfinite(c.t)) { snprintf(error, tamError, "linea %d: tiempo no finito", linea); return 0; }
+            q = r;
+            if (*q == ':') {
+                c.valor = strtof(q + 1, &r);
+                if (r == q + 1) { snprintf(error, tamError, "linea %d: falta el valor despues de ':'", linea); return 0; }
+                if (!isfinite(c.valor)) { snprintf(error, tamError, "linea %d: valor o duracion no finita", linea); return 0; }
+                q = r;
+            } else if (t == PISTA_VALOR) { snprintf(error, tamError, "linea %d: las claves de valor son t:valor", linea); return 0; }
+            pistas[id].claves.push_back(c);
+            while (*q == ' ' || *q == '\t' || *q == '\r') q++;
+        }
+    }
+
+    CabeceraLgui c;
+    memset(&c, 0, sizeof(c));
+    memcpy(c.magia, "LGUI", 4);
+    c.version = LGUI_VERSION;
+    std::vector<PistaGuion> tabla;
+    std::vector<ClaveGuion> claves;
+    for (int id = 0; id < numNombres; id++) {
+        PistaTexto& pt = pistas[id];
+        if (pt.tipo < 0 || pt.claves.empty()) continue;
+        std::stable_sort(pt.claves.begin(), pt.claves.end(), [](const ClaveGuion& a, const ClaveGuion& b) { return a.t < b.t; });
+        PistaGuion pg = { (uint32_t)id, (uint32_t)pt.tipo, (uint32_t)claves.size(), (uint32_t)pt.claves.size() };
+        tabla.push_back(pg);
+        claves.insert(claves.end(), pt.claves.begin(), pt.claves.end());
+    }
+    c.numPistas = (uint32_t)tabla.size(); c.numClaves = (uint32_t)claves.size();
+    c.desplazamientoPistas = sizeof(CabeceraLgui);
+    c.desplazamientoClaves = c.desplazamientoPistas + c.numPistas * sizeof(PistaGuion);
+    salida.resize(c.desplazamientoClaves + claves.size() * sizeof(ClaveGuion));
+    memcpy(salida.data(), &c, sizeof(c));
+    if (!tabla.empty()) memcpy(salida.data() + c.desplazamientoPistas, tabla.data(), tabla.size() * sizeof(PistaGuion));
+    if (!claves.empty()) memcpy(salida.data() + c.desplazamientoClaves, claves.data(), claves.size() * sizeof(ClaveGuion));
+    return 1;
+}
+
+inline int guionEscribir(const char* ruta, const std::vector<unsigned char>& datos) {
+    FILE* f = fopen(ruta, "wb");
+    if (!f) return 0;
+    fwrite(datos.data(), 1, datos.size(), f);
+    int ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
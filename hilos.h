@@ -0,0 +1,83 @@
+// hilos.h - Pool fijo de hilos de trabajo
+//
+// Los hilos se crean una sola vez y se reutilizan en cada tanda de trabajo
+// (tiles del rasterizador, instancias, frames). El hilo que llama tambien
+// trabaja, asi un pool de 0 hilos ejecuta todo en linea.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct PoolHilos {
+    std::vector<std::thread> hilos;
+    std::mutex mtx;
+    std::condition_variable cvTrabajo, cvFin;
+    const std::function<void(int)>* tarea = nullptr;
+    std::atomic<int> siguiente{0};
+    int total = 0;
+    int pendientes = 0;          // hilos que aun no terminan la tanda actual
+    unsigned generacion = 0;
+    bool salir = false;
+};
+
+inline void poolTrabajar(PoolHilos& p) {
+    int i;
+    while ((i = p.siguiente.fetch_add(1)) < p.total) (*p.tarea)(i);
+}
+
+inline void poolBucleHilo(PoolHilos* p) {
+    unsigned vista = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(p->mtx);
+            p->cvTrabajo.wait(lock, [&] { return p->salir || p->generacion != vista; });
+            if (p->salir) return;
+            vista = p->generacion;
+        }
+        poolTrabajar(*p);
+        std::lock_guard<std::mutex> lock(p->mtx);
+        if (--p->pendientes == 0) p->cvFin.notify_one();
+    }
+}
+
+// n < 0 usa un hilo por nucleo (menos el que llama)
+inline void poolIniciar(PoolHilos& p, int n) {
+    if (n < 0) n = (int)std::thread::hardware_concurrency() - 1;
+    for (int i = 0; i < n; i++) p.hilos.emplace_back(poolBucleHilo, &p);
+}
+
+inline void poolDetener(PoolHilos& p) {
+    {
+        std::lock_guard<std::mutex> lock(p.mtx);
+        p.salir = true;
+    }
+    p.cvTrabajo.notify_all();
+    for (auto& h : p.hilos) h.join();
+    p.hilos.clear();
+    p.salir = false;
+}
+
+inline int poolNumHilos(const PoolHilos& p) { return (int)p.hilos.size() + 1; }
+
+// Ejecuta fn(i) para cada i en [0,n) y vuelve cuando terminaron todos
+inline void poolParaCada(PoolHilos& p, int n, const std::function<void(int)>& fn) {
+    if (n <= 0) return;
+    if (p.hilos.empty() || n == 1) { for (int i = 0; i < n; i++) fn(i); return; }
+    {
+        std::lock_guard<std::mutex> lock(p.mtx);
+        p.tarea = &fn;
+        p.total = n;
+        p.siguiente.store(0);
+        p.pendientes = (int)p.hilos.size();
+        p.generacion++;
+    }
+    p.cvTrabajo.notify_all();
+    poolTrabajar(p);
+    std::unique_lock<std::mutex> lock(p.mtx);
+    p.cvFin.wait(lock, [&] { return p.pendientes == 0; });
+    p.tarea = nullptr;
+}
@@ -0,0 +1,81 @@
+// mipmaps.h - Cadena de mipmaps RGBA8 generada en CPU
+//
+// Cada nivel es la mitad del anterior (redondeando hacia abajo, minimo 1)
+// hasta llegar a 1x1, con las mismas dimensiones que espera glTexImage2D.
+// El filtro es un promedio de caja 2x2 (lo que hace glGenerateMipmap en la
+// practica); en dimensiones impares se descarta la ultima fila/columna y en
+// dimension 1 se repite el texel. Lo usan los dos backends y --hornear, asi
+// todos ven los mismos niveles.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SSE2 1
+#endif
+
+#define MAX_NIVELES_MIP 16
+
+inline int dimNivel(int dim, int nivel) {
+    int d = dim >> nivel;
+    return d > 0 ? d : 1;
+}
+
+// Niveles de la cadena completa hasta 1x1
+inline int nivelesCompletos(int ancho, int alto) {
+    int n = 1, mayor = ancho > alto ? ancho : alto;
+    while ((mayor >> n) > 0 && n < MAX_NIVELES_MIP) n++;
+    return n;
+}
+
+inline uint32_t promedio4(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    uint32_t r = 0;
+    for (int s = 0; s < 32; s += 8)
+        r |= ((((a >> s) & 255) + ((b >> s) & 255) + ((c >> s) & 255) + ((d >> s) & 255) + 2) >> 2) << s;
+    return r;
+}
+
+// src (ancho x alto) -> dst (dimNivel(ancho,1) x dimNivel(alto,1))
+inline void reducirNivel(const uint32_t* src, int ancho, int alto, uint32_t* dst) {
+    int w = dimNivel(ancho, 1), h = dimNivel(alto, 1);
+    for (int y = 0; y < h; y++) {
+        const uint32_t* f0 = src + (size_t)(2 * y) * ancho;
+        const uint32_t* f1 = (2 * y + 1 < alto) ? f0 + ancho : f0;
+        uint32_t* d = dst + (size_t)y * w;
+        int x = 0;
+        if (ancho == 1) {
+            for (; x < w; x++) d[x] = promedio4(f0[0], f0[0], f1[0], f1[0]);
+            continue;
+        }
+#ifdef MIP_SSE2
+        // 2 texels de salida por vuelta: 4 de cada fila, canales a 16 bits
+        const __m128i cero = _mm_setzero_si128(), dos = _mm_set1_epi16(2);
+        for (; x + 1 < w; x += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(f0 + 2 * x));
+            __m128i b = _mm_loadu_si128((const __m128i*)(f1 + 2 * x));
+            __m128i bajos = _mm_add_epi16(_mm_unpacklo_epi8(a, cero), _mm_unpacklo_epi8(b, cero));   // t0 t1
+            __m128i altos = _mm_add_epi16(_mm_unpackhi_epi8(a, cero), _mm_unpackhi_epi8(b, cero));   // t2 t3
+            __m128i suma = _mm_add_epi16(_mm_unpacklo_epi64(bajos, altos), _mm_unpackhi_epi64(bajos, altos));
+            suma = _mm_srli_epi16(_mm_add_epi16(suma, dos), 2);
+            _mm_storel_epi64((__m128i*)(d + x), _mm_packus_epi16(suma, cero));
+        }
+#endif
+        for (; x < w; x++) d[x] = promedio4(f0[2 * x], f0[2 * x + 1], f1[2 * x], f1[2 * x + 1]);
+    }
+}
+
+// Llena cadena con todos los niveles seguidos (el 0 es una copia de base) e
+// inicio[n] con el texel donde empieza el nivel n. Devuelve la cantidad de niveles.
+inline int generarMipmaps(const uint32_t* base, int ancho, int alto, std::vector<uint32_t>& cadena, size_t inicio[MAX_NIVELES_MIP]) {
+    int niveles = nivelesCompletos(ancho, alto);
+    size_t total = 0;
+    for (int n = 0; n < niveles; n++) { inicio[n] = total; total += (size_t)dimNivel(ancho, n) * dimNivel(alto, n); }
+    cadena.resize(total);
+    memcpy(cadena.data(), base, (size_t)ancho * alto * sizeof(uint32_t));
+    for (int n = 1; n < niveles; n++)
+        reducirNivel(&cadena[inicio[n - 1]], dimNivel(ancho, n - 1), dimNivel(alto, n - 1), &cadena[inicio[n]]);
+    return niveles;
+}
@@ -0,0 +1,193 @@
+// particulas.h - Pools de particulas en arreglos por campo (SoA)
+//
+// Cada pool es un tipo de particula con su fisica (gravedad, arrastre, suelo
+// con rebote) y capacidad fija: los arreglos se reservan una vez en
+// partIniciar y despues no se asigna memoria. Las vivas estan siempre
+// compactas en [0, vivas): al morir una, la ultima ocupa su lugar, asi el
+// hueco se recicla en la siguiente emision y los arreglos se pueden mandar
+// enteros como instancias en una sola llamada de dibujo.
+//
+// La integracion (Euler semi-implicito) va de a 4 particulas con SSE2 si
+// esta disponible y se puede repartir en tandas entre los hilos de un pool.
+// partEmitirConEdad salta directo al estado de una particula N pasos despues
+// de emitida, para quien arma el pool de un instante sin su historia.
+// Incluir despues de render.h.
+#pragma once
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "hilos.h"
+#include "perfil.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PART_SSE2 1
+#endif
+
+#define TAM_TANDA_PARTICULAS 16384
+
+typedef struct {
+    float gravedad;       // aceleracion vertical (unidades de escena / s^2)
+    float arrastre;       // fraccion de la velocidad que se pierde por segundo
+    float crecimiento;    // el tamano crece esto por segundo
+    float suelo;          // y minima
+    float rebote;         // < 0: sin suelo; si no, fraccion de vy que se conserva al tocarlo
+    float roce;           // fraccion de vx y del giro que se conserva al tocar el suelo
+} FisicaParticulas;
+
+struct PoolParticulas {
+    int capacidad = 0, vivas = 0;
+    FisicaParticulas fisica;
+    std::vector<float> x, y, vx, vy, vida, angulo, giro, tam;   // vida en segundos
+    std::vector<Matriz2D> matrices;                              // instancias del ultimo partMatrices
+};
+
+inline void partIniciar(PoolParticulas& p, int capacidad, const FisicaParticulas& fisica) {
+    p.capacidad = capacidad; p.vivas = 0; p.fisica = fisica;
+    for (std::vector<float>* v : { &p.x, &p.y, &p.vx, &p.vy, &p.vida, &p.angulo, &p.giro, &p.tam })
+        v->assign(capacidad, 0.0f);
+    p.matrices.resize(capacidad);
+}
+
+inline void partVaciar(PoolParticulas& p) { p.vivas = 0; }
+
+// Devuelve 0 si el pool esta lleno (la particula se descarta)
+inline int partEmitir(PoolParticulas& p, float x, float y, float vx, float vy, float vida, float angulo, float giro, float tam) {
+    if (p.vivas >= p.capacidad) return 0;
+    int i = p.vivas++;
+    p.x[i] = x; p.y[i] = y; p.vx[i] = vx; p.vy[i] = vy;
+    p.vida[i] = vida; p.angulo[i] = angulo; p.giro[i] = giro; p.tam[i] = tam;
+    return 1;
+}
+
+// Emite una particula que salio hace 'pasos' pasos de dt, ya movida hasta
+// ahora, sin simular los pasos intermedios de las demas. Sin suelo la
+// velocidad es una serie geometrica y el estado sale en forma cerrada. Con
+// suelo se integra sola, paso a paso como partIntegrarRango, hasta que queda
+// quieta: un paso apoyado en el suelo que no mueve x, y ni el angulo tampoco
+// los mueve despues, porque el roce y el rebote solo achican las velocidades.
+// Devuelve 0 si ya murio o si el pool esta lleno.
+inline int partEmitirConEdad(PoolParticulas& p, float x, float y, float vx, float vy, float vida, float angulo,
+                             float giro, float tam, int pasos, float dt) {
+    const FisicaParticulas& f = p.fisica;
+    vida -= pasos * dt;
+    if (vida <= 0.0f) return 0;
+    tam += pasos * f.crecimiento * dt;
+    float frenado = std::max(0.0f, 1.0f - f.arrastre * dt);
+    if (f.rebote < 0.0f) {
+        double fr = frenado, fn = pow(fr, pasos), c = (double)f.gravedad * dt, h = dt;
+        double s = fr == 1.0 ? pasos : (1.0 - fn) / (1.0 - fr);                          // frenado^j, j < pasos
+        double ss = fr == 1.0 ? 0.5 * pasos * (pasos + 1) : (pasos - fr * s) / (1.0 - fr);   // s de 1 a pasos
+        x += (float)(h * vx * fr * s);
+        y += (float)(h * (vy * fr * s + c * ss));
+        vx = (float)(vx * fn);
+        vy = (float)(vy * fn + c * s);
+        angulo += pasos * giro * dt;
+    } else {
+        for (int k = 0; k < pasos; k++) {
+            float x0 = x, y0 = y, a0 = angulo;
+            vx *= frenado;
+            vy = vy * frenado + f.gravedad * dt;
+            x += vx * dt;
+            y += vy * dt;
+            if (y < f.suelo) { y = f.suelo; vy *= -f.rebote; vx *= f.roce; giro *= f.roce; }
+            angulo += giro * dt;
+            if (y == f.suelo && y == y0 && x == x0 && angulo == a0) break;
+        }
+    }
+    return partEmitir(p, x, y, vx, vy, vida, angulo, giro, tam);
+}
+
+// Integra las particulas [desde, hasta)
+inline void partIntegrarRango(PoolParticulas& p, float dt, int desde, int hasta) {
+    const FisicaParticulas& f = p.fisica;
+    float frenado = std::max(0.0f, 1.0f - f.arrastre * dt);
+    float* x = p.x.data(); float* y = p.y.data(); float* vx = p.vx.data(); float* vy = p.vy.data();
+    float* vida = p.vida.data(); float* angulo = p.angulo.data(); float* giro = p.giro.data(); float* tam = p.tam.data();
+    int i = desde;
+#ifdef PART_SSE2
+    const __m128 vdt = _mm_set1_ps(dt), vg = _mm_set1_ps(f.gravedad * dt), vfren = _mm_set1_ps(frenado);
+    const __m128 vcrec = _mm_set1_ps(f.crecimiento * dt);
+    const __m128 vsuelo = _mm_set1_ps(f.suelo), vrebote = _mm_set1_ps(-f.rebote), vroce = _mm_set1_ps(f.roce);
+    const bool haySuelo = f.rebote >= 0.0f;
+    for (; i + 4 <= hasta; i += 4) {
+        __m128 nvx = _mm_mul_ps(_mm_loadu_ps(vx + i), vfren);
+        __m128 nvy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(vy + i), vfren), vg);
+        __m128 nx = _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(nvx, vdt));
+        __m128 ny = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(nvy, vdt));
+        __m128 ngiro = _mm_loadu_ps(giro + i);
+        if (haySuelo) {   // las que cruzaron el suelo quedan sobre el, rebotando y frenadas
+            __m128 toca = _mm_cmplt_ps(ny, vsuelo);
+            ny = _mm_or_ps(_mm_and_ps(toca, vsuelo), _mm_andnot_ps(toca, ny));
+            nvy = _mm_or_ps(_mm_and_ps(toca, _mm_mul_ps(nvy, vrebote)), _mm_andnot_ps(toca, nvy));
+            nvx = _mm_or_ps(_mm_and_ps(toca, _mm_mul_ps(nvx, vroce)), _mm_andnot_ps(toca, nvx));
+            ngiro = _mm_or_ps(_mm_and_ps(toca, _mm_mul_ps(ngiro, vroce)), _mm_andnot_ps(toca, ngiro));
+        }
+        _mm_storeu_ps(vx + i, nvx); _mm_storeu_ps(vy + i, nvy);
+        _mm_storeu_ps(x + i, nx); _mm_storeu_ps(y + i, ny);
+        _mm_storeu_ps(giro + i, ngiro);
+        _mm_storeu_ps(angulo + i, _mm_add_ps(_mm_loadu_ps(angulo + i), _mm_mul_ps(ngiro, vdt)));
+        _mm_storeu_ps(tam + i, _mm_add_ps(_mm_loadu_ps(tam + i), vcrec));
+        _mm_storeu_ps(vida + i, _mm_sub_ps(_mm_loadu_ps(vida + i), vdt));
+    }
+#endif
+    for (; i < hasta; i++) {
+        vx[i] *= frenado;
+        vy[i] = vy[i] * frenado + f.gravedad * dt;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        if (f.rebote >= 0.0f && y[i] < f.suelo) {
+            y[i] = f.suelo; vy[i] *= -f.rebote; vx[i] *= f.roce; giro[i] *= f.roce;
+        }
+        angulo[i] += giro[i] * dt;
+        tam[i] += f.crecimiento * dt;
+        vida[i] -= dt;
+    }
+}
+
+// Saca las muertas llenando cada hueco con la ultima viva
+inline void partRecoger(PoolParticulas& p) {
+    for (int i = p.vivas - 1; i >= 0; i--) {
+        if (p.vida[i] > 0.0f) continue;
+        int u = --p.vivas;
+        p.x[i] = p.x[u]; p.y[i] = p.y[u]; p.vx[i] = p.vx[u]; p.vy[i] = p.vy[u];
+        p.vida[i] = p.vida[u]; p.angulo[i] = p.angulo[u]; p.giro[i] = p.giro[u]; p.tam[i] = p.tam[u];
+    }
+}
+
+// Un paso de dt segundos. Con pool, la integracion se reparte en tandas
+inline void partAvanzar(PoolParticulas& p, float dt, PoolHilos* pool) {
+    ZONA_PERFIL("partAvanzar");
+    int tandas = (p.vivas + TAM_TANDA_PARTICULAS - 1) / TAM_TANDA_PARTICULAS;
+    auto tanda = [&p, dt](int k) {
+        partIntegrarRango(p, dt, k * TAM_TANDA_PARTICULAS, std::min(p.vivas, (k + 1) * TAM_TANDA_PARTICULAS));
+    };
+    if (pool && tandas > 1) poolParaCada(*pool, tandas, tanda);
+    else for (int k = 0; k < tandas; k++) tanda(k);
+    partRecoger(p);
+}
+
+// Llena p.matrices con una instancia de ancho x alto (por tam) por particula.
+// Con alinear, el eje x sigue a la velocidad (chispas) en vez del angulo.
+inline void partMatrices(PoolParticulas& p, float ancho, float alto, float z, int alinear, PoolHilos* pool) {
+    ZONA_PERFIL("partMatrices");
+    int tandas = (p.vivas + TAM_TANDA_PARTICULAS - 1) / TAM_TANDA_PARTICULAS;
+    auto tanda = [&p, ancho, alto, z, alinear](int k) {
+        int fin = std::min(p.vivas, (k + 1) * TAM_TANDA_PARTICULAS);
+        for (int i = k * TAM_TANDA_PARTICULAS; i < fin; i++) {
+            float c, s;
+            if (alinear) {
+                float largo = sqrtf(p.vx[i] * p.vx[i] + p.vy[i] * p.vy[i]);
+                c = largo > 0.0f ? p.vx[i] / largo : 1.0f; s = largo > 0.0f ? p.vy[i] / largo : 0.0f;
+            } else { c = cosf(p.angulo[i]); s = sinf(p.angulo[i]); }
+            float sx = ancho * p.tam[i], sy = alto * p.tam[i];
+            Matriz2D& m = p.matrices[i];
+            m.a = c * sx; m.b = s * sx; m.c = -s * sy; m.d = c * sy;
+            m.tx = p.x[i]; m.ty = p.y[i]; m.tz = z;
+        }
+    };
+    if (pool && tandas > 1) poolParaCada(*pool, tandas, tanda);
+    else for (int k = 0; k < tandas; k++) tanda(k);
+}
@@ -0,0 +1,127 @@
+// perfil.h - Zonas de medicion de tiempo por frame
+//
+// ZONA_PERFIL("nombre") mide el bloque donde se declara. Cada hilo anota sus
+// zonas en un buffer circular propio (sin locks en el camino caliente); si se
+// llena se pisan las mas viejas. Con el perfil apagado una zona cuesta una
+// sola comparacion.
+//
+// Al salir: perfilInforme() da llamadas, media y p50/p95/p99 por zona, y
+// perfilGuardarTraza() escribe un JSON de trace events para chrome://tracing
+// o Perfetto.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CAPACIDAD_PERFIL (1 << 17)   // eventos por hilo
+
+struct EventoPerfil {
+    const char* nombre;
+    uint64_t inicio, duracion;         // ns desde perfilInicio
+};
+
+struct BufferPerfil {
+    std::vector<EventoPerfil> eventos;
+    uint64_t escritos = 0;
+    int hilo = 0;
+};
+
+bool perfilActivo = false;
+std::chrono::steady_clock::time_point perfilInicio = std::chrono::steady_clock::now();
+std::mutex mtxPerfil;
+std::vector<BufferPerfil*> buffersPerfil;
+
+inline uint64_t perfilAhora() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - perfilInicio).count();
+}
+
+// El buffer se crea la primera vez que el hilo registra algo y vive hasta el final
+inline BufferPerfil& perfilBufferHilo() {
+    thread_local BufferPerfil* b = nullptr;
+    if (!b) {
+        b = new BufferPerfil;
+        b->eventos.resize(CAPACIDAD_PERFIL);
+        std::lock_guard<std::mutex> lock(mtxPerfil);
+        b->hilo = (int)buffersPerfil.size();
+        buffersPerfil.push_back(b);
+    }
+    return *b;
+}
+
+inline void perfilRegistrar(const char* nombre, uint64_t inicio, uint64_t duracion) {
+    BufferPerfil& b = perfilBufferHilo();
+    EventoPerfil& e = b.eventos[b.escritos % CAPACIDAD_PERFIL];
+    e.nombre = nombre; e.inicio = inicio; e.duracion = duracion;
+    b.escritos++;
+}
+
+struct ZonaPerfil {
+    const char* nombre;
+    uint64_t inicio;
+    explicit ZonaPerfil(const char* n) : nombre(perfilActivo ? n : nullptr), inicio(nombre ? perfilAhora() : 0) {}
+    ~ZonaPerfil() { if (nombre) perfilRegistrar(nombre, inicio, perfilAhora() - inicio); }
+};
+
+#define ZONA_PERFIL_UNIR2(a, b) a##b
+#define ZONA_PERFIL_UNIR(a, b) ZONA_PERFIL_UNIR2(a, b)
+#define ZONA_PERFIL(nombre) ZonaPerfil ZONA_PERFIL_UNIR(zonaPerfil, __LINE__)(nombre)
+
+// Recorre los eventos que siguen en los buffers (los ultimos CAPACIDAD_PERFIL
+// de cada hilo). Llamar con los demas hilos ya detenidos.
+template <typename F>
+void perfilRecorrer(F fn) {
+    for (BufferPerfil* b : buffersPerfil) {
+        uint64_t primero = b->escritos > CAPACIDAD_PERFIL ? b->escritos - CAPACIDAD_PERFIL : 0;
+        for (uint64_t i = primero; i < b->escritos; i++) fn(*b, b->eventos[i % CAPACIDAD_PERFIL]);
+    }
+}
+
+inline double perfilPercentil(const std::vector<uint64_t>& ordenadas, double p) {
+    size_t i = (size_t)(p * (ordenadas.size() - 1) + 0.5);
+    return ordenadas[i] / 1e6;
+}
+
+inline void perfilInforme() {
+    std::map<std::string, std::vector<uint64_t>> zonas;
+    uint64_t perdidos = 0;
+    perfilRecorrer([&](const BufferPerfil&, const EventoPerfil& e) { zonas[e.nombre].push_back(e.duracion); });
+    for (BufferPerfil* b : buffersPerfil) if (b->escritos > CAPACIDAD_PERFIL) perdidos += b->escritos - CAPACIDAD_PERFIL;
+
+    printf(">> PERFIL (ms)               llamadas      media       p50       p95       p99      total\n");
+    for (auto& z : zonas) {
+        std::vector<uint64_t>& d = z.second;
+        std::sort(d.begin(), d.end());
+        uint64_t total = 0;
+        for (uint64_t v : d) total += v;
+        printf("   %-24s %10zu %10.4f %9.4f %9.4f %9.4f %10.2f\n", z.first.c_str(), d.size(), total / 1e6 / d.size(),
+               perfilPercentil(d, 0.50), perfilPercentil(d, 0.95), perfilPercentil(d, 0.99), total / 1e6);
+    }
+    if (perdidos) printf(">> (se descartaron %llu eventos viejos: buffers llenos)\n", (unsigned long long)perdidos);
+}
+
+// Formato "Trace Event": un evento completo ("X") por zona, tiempos en us
+inline int perfilGuardarTraza(const char* ruta) {
+    FILE* f = fopen(ruta, "w");
+    if (!f) return 0;
+    fprintf(f, "{\"traceEvents\":[\n");
+    int primero = 1;
+    for (BufferPerfil* b : buffersPerfil) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                primero ? "" : ",\n", b->hilo, b->hilo == 0 ? "principal" : "hilo", b->hilo);
+        primero = 0;
+    }
+    perfilRecorrer([&](const BufferPerfil& b, const EventoPerfil& e) {
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                e.nombre, b.hilo, e.inicio / 1e3, e.duracion / 1e3);
+    });
+    fprintf(f, "\n]}\n");
+    int ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,456 @@
+// rasterizador.h - Rasterizador por software (modo headless / sin GPU)
+//
+// Dibuja triangulos y lineas ya transformados a coordenadas de ventana en un
+// framebuffer en memoria. Sigue las mismas reglas que OpenGL para que la
+// imagen sea comparable pixel a pixel: centros de pixel en (i+0.5, j+0.5),
+// regla top-left en los bordes, test de profundidad GL_LESS, blending
+// GL_SRC_ALPHA / GL_ONE_MINUS_SRC_ALPHA y texturas GL_LINEAR_MIPMAP_LINEAR +
+// GL_REPEAT en modo GL_MODULATE.
+//
+// Las primitivas de un frame se preparan al enviarlas y se reparten en bins
+// por tile; al cerrar el frame cada tile se rasteriza de forma independiente
+// (en paralelo si hay pool de hilos) respetando el orden de envio dentro del
+// tile, que es lo que necesitan el test de profundidad y el blending.
+//
+// Cada primitiva lleva un hash de lo que la define y cada tile resume los de
+// su bin (y el fondo). Si el resumen es el del frame anterior y la lista de
+// primitivas guardada de ese frame es igual a la nueva, el tile ya tiene esos
+// pixeles y no se vuelve a rasterizar: lo que no se mueve no cuesta. El hash
+// solo descarta rapido; no se confia en el para dar un tile por bueno.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "hilos.h"
+#include "mipmaps.h"
+#include "perfil.h"
+
+#define TAM_TILE 64
+
+// Vertice en coordenadas de ventana: x,y en pixeles (origen abajo-izquierda,
+// como glViewport), z = profundidad en [0,1]
+struct VerticeRaster { float x, y, z, u, v; };
+
+struct Framebuffer {
+    int ancho = 0, alto = 0;
+    std::vector<uint32_t> color;      // RGBA8, la fila 0 es la de abajo (igual que glReadPixels)
+    std::vector<float> profundidad;
+};
+
+// Textura RGBA8; la fila 0 corresponde a t = 0, como tras glTexImage2D.
+// texels tiene todos los mipmaps seguidos; el nivel n empieza en inicio[n]
+struct TexturaCPU {
+    int ancho = 0, alto = 0;
+    int niveles = 1;
+    size_t inicio[MAX_NIVELES_MIP] = {0};
+    std::vector<uint32_t> texels;
+};
+
+inline uint32_t empaquetarRGBA(float r, float g, float b, float a) {
+    auto canal = [](float c) -> uint32_t {
+        if (c <= 0.0f) return 0;
+        if (c >= 1.0f) return 255;
+        return (uint32_t)(c * 255.0f + 0.5f);
+    };
+    return canal(r) | (canal(g) << 8) | (canal(b) << 16) | (canal(a) << 24);
+}
+
+inline void fbCrear(Framebuffer& fb, int ancho, int alto) {
+    fb.ancho = ancho; fb.alto = alto;
+    fb.color.assign((size_t)ancho * alto, 0);
+    fb.profundidad.assign((size_t)ancho * alto, 1.0f);
+}
+
+inline void fbLimpiar(Framebuffer& fb, const float col[3], float prof) {
+    uint32_t c = empaquetarRGBA(col[0], col[1], col[2], 1.0f);
+    std::fill(fb.color.begin(), fb.color.end(), c);
+    std::fill(fb.profundidad.begin(), fb.profundidad.end(), prof);
+}
+
+// Escribe un fragmento con test de profundidad y blending
+inline void fbFragmento(Framebuffer& fb, int idx, float z, const float col[4]) {
+    if (!(z < fb.profundidad[idx])) return;
+    fb.profundidad[idx] = z;
+    if (col[3] >= 1.0f) { fb.color[idx] = empaquetarRGBA(col[0], col[1], col[2], 1.0f); return; }
+    uint32_t d = fb.color[idx];
+    float a = col[3], ia = 1.0f - a;
+    fb.color[idx] = empaquetarRGBA(col[0] * a + (d & 255) / 255.0f * ia,
+                                   col[1] * a + ((d >> 8) & 255) / 255.0f * ia,
+                                   col[2] * a + ((d >> 16) & 255) / 255.0f * ia,
+                                   col[3] * a + (d >> 24) / 255.0f * ia);
+}
+
+// Muestreo bilineal con repeticion (GL_LINEAR + GL_REPEAT) en un nivel
+inline void texMuestrearNivel(const TexturaCPU& t, int nivel, float u, float v, float out[4]) {
+    int ancho = dimNivel(t.ancho, nivel), alto = dimNivel(t.alto, nivel);
+    const uint32_t* texels = &t.texels[t.inicio[nivel]];
+    float fx = u * ancho - 0.5f, fy = v * alto - 0.5f;
+    float bx = floorf(fx), by = floorf(fy);
+    float ax = fx - bx, ay = fy - by;
+    int x0 = (int)bx % ancho, y0 = (int)by % alto;
+    if (x0 < 0) x0 += ancho;
+    if (y0 < 0) y0 += alto;
+    int x1 = (x0 + 1) % ancho, y1 = (y0 + 1) % alto;
+    uint32_t c00 = texels[y0 * ancho + x0], c10 = texels[y0 * ancho + x1];
+    uint32_t c01 = texels[y1 * ancho + x0], c11 = texels[y1 * ancho + x1];
+    for (int k = 0; k < 4; k++) {
+        int s = k * 8;
+        float a0 = ((c00 >> s) & 255) * (1 - ax) + ((c10 >> s) & 255) * ax;
+        float a1 = ((c01 >> s) & 255) * (1 - ax) + ((c11 >> s) & 255) * ax;
+        out[k] = (a0 * (1 - ay) + a1 * ay) / 255.0f;
+    }
+}
+
+// Trilineal (GL_LINEAR_MIPMAP_LINEAR): lod <= 0 es magnificacion y usa solo
+// el nivel 0; si no, mezcla los dos niveles que rodean a lod
+inline void texMuestrear(const TexturaCPU& t, float u, float v, float lod, float out[4]) {
+    if (lod <= 0.0f || t.niveles == 1) { texMuestrearNivel(t, 0, u, v, out); return; }
+    int n0 = (int)lod;
+    if (n0 >= t.niveles - 1) { texMuestrearNivel(t, t.niveles - 1, u, v, out); return; }
+    float f = lod - n0, otro[4];
+    texMuestrearNivel(t, n0, u, v, out);
+    texMuestrearNivel(t, n0 + 1, u, v, otro);
+    for (int k = 0; k < 4; k++) out[k] += (otro[k] - out[k]) * f;
+}
+
+// En 2D los UV son afines en pantalla: las derivadas son constantes en todo
+// el triangulo y el nivel de detalle se calcula una vez (como rho en la
+// especificacion de GL, con la mayor de las dos direcciones)
+inline float lodTriangulo(const VerticeRaster v[3], const TexturaCPU& t) {
+    float x1 = v[1].x - v[0].x, y1 = v[1].y - v[0].y, x2 = v[2].x - v[0].x, y2 = v[2].y - v[0].y;
+    float det = x1 * y2 - y1 * x2;
+    if (det == 0.0f) return 0.0f;
+    float u1 = (v[1].u - v[0].u) * t.ancho, u2 = (v[2].u - v[0].u) * t.ancho;
+    float w1 = (v[1].v - v[0].v) * t.alto, w2 = (v[2].v - v[0].v) * t.alto;
+    float dudx = (u1 * y2 - u2 * y1) / det, dvdx = (w1 * y2 - w2 * y1) / det;
+    float dudy = (u2 * x1 - u1 * x2) / det, dvdy = (w2 * x1 - w1 * x2) / det;
+    float rho2 = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+    return rho2 > 0.0f ? 0.5f * log2f(rho2) : 0.0f;
+}
+
+// Hash de 64 bits de a 8 bytes (mezcla de murmur3); n no necesita ser multiplo de 8
+inline uint64_t hashPalabras(const void* datos, size_t n, uint64_t h = 0x9E3779B97F4A7C15ull) {
+    const unsigned char* p = (const unsigned char*)datos;
+    h ^= n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    for (; i < n; i++) h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+// --- PRIMITIVAS PREPARADAS ---
+
+struct PrimRaster {
+    int esLinea;
+    int x0, y0, x1, y1;                 // caja en pixeles (inclusive)
+    // Triangulo en punto fijo 24.8 (como el subpixel del hardware), aristas
+    // opuestas a cada vertice y su clasificacion top-left
+    int64_t X[3], Y[3], dX[3], dY[3];
+    bool topLeft[3];
+    bool zPlana;
+    float invArea;
+    VerticeRaster v[3];                 // en lineas solo se usan v[0] y v[1]
+    float col[4];
+    const TexturaCPU* tex;
+    float lod;                          // nivel de detalle de la textura (ver lodTriangulo)
+    uint64_t hash;                      // de lo anterior (ver hashPrim)
+};
+
+// Lo que decide los pixeles: vertices, color, textura y lod (el resto se deriva)
+inline uint64_t hashPrim(const PrimRaster& p) {
+    uint64_t h = hashPalabras(p.v, (p.esLinea ? 2 : 3) * sizeof(VerticeRaster), (uint64_t)p.esLinea);
+    h = hashPalabras(p.col, sizeof(p.col), h);
+    h = hashPalabras(&p.tex, sizeof(p.tex), h);
+    return hashPalabras(&p.lod, sizeof(p.lod), h);
+}
+
+// Devuelve 0 si el triangulo es degenerado o queda fuera de pantalla
+inline int prepararTriangulo(PrimRaster& p, const VerticeRaster& a, const VerticeRaster& b, const VerticeRaster& c,
+                             int ancho, int alto) {
+    p.esLinea = 0;
+    p.v[0] = a; p.v[1] = b; p.v[2] = c;
+    for (int i = 0; i < 3; i++) { p.X[i] = (int64_t)lroundf(p.v[i].x * 256.0f); p.Y[i] = (int64_t)lroundf(p.v[i].y * 256.0f); }
+
+    int64_t area = (p.X[1] - p.X[0]) * (p.Y[2] - p.Y[0]) - (p.Y[1] - p.Y[0]) * (p.X[2] - p.X[0]);
+    if (area == 0) return 0;
+    if (area < 0) {   // sin culling: se reordena a sentido antihorario
+        std::swap(p.v[1], p.v[2]); std::swap(p.X[1], p.X[2]); std::swap(p.Y[1], p.Y[2]);
+        area = -area;
+    }
+
+    int64_t minX = std::min(p.X[0], std::min(p.X[1], p.X[2])), maxX = std::max(p.X[0], std::max(p.X[1], p.X[2]));
+    int64_t minY = std::min(p.Y[0], std::min(p.Y[1], p.Y[2])), maxY = std::max(p.Y[0], std::max(p.Y[1], p.Y[2]));
+    p.x0 = std::max(0, (int)((minX - 128 + 255) >> 8)); p.x1 = std::min(ancho - 1, (int)((maxX - 128) >> 8));
+    p.y0 = std::max(0, (int)((minY - 128 + 255) >> 8)); p.y1 = std::min(alto - 1, (int)((maxY - 128) >> 8));
+    if (p.x0 > p.x1 || p.y0 > p.y1) return 0;
+
+    // Top-left con y hacia arriba y sentido antihorario: los bordes izquierdos
+    // bajan (dy < 0) y los superiores van hacia la izquierda
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        p.dX[i] = p.X[k] - p.X[j]; p.dY[i] = p.Y[k] - p.Y[j];
+        p.topLeft[i] = (p.dY[i] < 0) || (p.dY[i] == 0 && p.dX[i] < 0);
+    }
+    p.zPlana = (p.v[0].z == p.v[1].z && p.v[1].z == p.v[2].z);
+    p.invArea = 1.0f / (float)area;
+    return 1;
+}
+
+inline int prepararLinea(PrimRaster& p, const VerticeRaster& a, const VerticeRaster& b, int ancho, int alto) {
+    p.esLinea = 1;
+    p.v[0] = a; p.v[1] = b;
+    if (a.x == b.x && a.y == b.y) return 0;
+    p.x0 = std::max(0, (int)floorf(std::min(a.x, b.x))); p.x1 = std::min(ancho - 1, (int)floorf(std::max(a.x, b.x)));
+    p.y0 = std::max(0, (int)floorf(std::min(a.y, b.y))); p.y1 = std::min(alto - 1, (int)floorf(std::max(a.y, b.y)));
+    return p.x0 <= p.x1 && p.y0 <= p.y1;
+}
+
+// Rasteriza un triangulo preparado limitado al rectangulo [tx0,tx1]x[ty0,ty1]
+inline void rasterTrianguloEnTile(Framebuffer& fb, const PrimRaster& p, int tx0, int ty0, int tx1, int ty1) {
+    int x0 = std::max(p.x0, tx0), x1 = std::min(p.x1, tx1);
+    int y0 = std::max(p.y0, ty0), y1 = std::min(p.y1, ty1);
+    if (x0 > x1 || y0 > y1) return;
+
+    int64_t fila[3];
+    int64_t px = (int64_t)x0 * 256 + 128, py = (int64_t)y0 * 256 + 128;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        fila[i] = p.dX[i] * (py - p.Y[j]) - p.dY[i] * (px - p.X[j]);
+    }
+
+    float col[4] = { p.col[0], p.col[1], p.col[2], p.col[3] };
+    for (int y = y0; y <= y1; y++) {
+        int64_t w[3] = { fila[0], fila[1], fila[2] };
+        int idx = y * fb.ancho + x0;
+        for (int x = x0; x <= x1; x++, idx++) {
+            if ((w[0] > 0 || (w[0] == 0 && p.topLeft[0])) &&
+                (w[1] > 0 || (w[1] == 0 && p.topLeft[1])) &&
+                (w[2] > 0 || (w[2] == 0 && p.topLeft[2]))) {
+                float b0 = (float)w[0] * p.invArea, b1 = (float)w[1] * p.invArea, b2 = (float)w[2] * p.invArea;
+                float z = p.zPlana ? p.v[0].z : b0 * p.v[0].z + b1 * p.v[1].z + b2 * p.v[2].z;
+                if (p.tex) {
+                    float texel[4];
+                    texMuestrear(*p.tex, b0 * p.v[0].u + b1 * p.v[1].u + b2 * p.v[2].u,
+                                         b0 * p.v[0].v + b1 * p.v[1].v + b2 * p.v[2].v, p.lod, texel);
+                    for (int k = 0; k < 4; k++) col[k] = p.col[k] * texel[k];
+                }
+                fbFragmento(fb, idx, z, col);
+            }
+            for (int i = 0; i < 3; i++) w[i] -= p.dY[i] * 256;
+        }
+        for (int i = 0; i < 3; i++) fila[i] += p.dX[i] * 256;
+    }
+}
+
+// Linea de 1 pixel: se pinta el pixel de cada columna (o fila) cuyo centro
+// cae dentro del segmento semiabierto, como la regla diamond-exit.
+inline void rasterLineaEnTile(Framebuffer& fb, const PrimRaster& p, int tx0, int ty0, int tx1, int ty1) {
+    const VerticeRaster& a = p.v[0];
+    const VerticeRaster& b = p.v[1];
+    float dx = b.x - a.x, dy = b.y - a.y;
+    bool mayorX = fabsf(dx) >= fabsf(dy);
+    float d = mayorX ? dx : dy;
+    float ini = mayorX ? a.x : a.y, fin = mayorX ? b.x : b.y;
+    int i0 = (int)ceilf(std::min(ini, fin) - 0.5f), i1 = (int)ceilf(std::max(ini, fin) - 0.5f);
+    i0 = std::max(i0, mayorX ? tx0 : ty0); i1 = std::min(i1, (mayorX ? tx1 : ty1) + 1);
+    for (int i = i0; i < i1; i++) {
+        float t = (i + 0.5f - ini) / d;
+        int j = (int)floorf(mayorX ? a.y + t * dy : a.x + t * dx);
+        int px = mayorX ? i : j, py = mayorX ? j : i;
+        if (px < tx0 || py < ty0 || px > tx1 || py > ty1) continue;
+        fbFragmento(fb, py * fb.ancho + px, a.z + t * (b.z - a.z), p.col);
+    }
+}
+
+// --- RASTERIZADOR POR TILES ---
+
+// Lo que dejo en el framebuffer el ultimo flush que lo dibujo, tile por tile
+struct HistorialTiles {
+    std::vector<uint64_t> hash;                 // resumen por tile (0 = no vale)
+    std::vector<PrimRaster> prims;
+    std::vector<std::vector<uint32_t>> bins;
+    float fondo[3] = {0, 0, 0};
+    int generacion = -1;                        // la lleva quien usa el rasterizador (render.h)
+};
+
+struct RasterizadorCPU {
+    Framebuffer fb;
+    int tilesX = 0, tilesY = 0;
+    std::vector<PrimRaster> prims;
+    std::vector<std::vector<uint32_t>> bins;   // indices de prims por tile, en orden de envio
+    float fondo[3] = {0, 0, 0};
+    PoolHilos* pool = nullptr;                  // null = un solo hilo
+    // Reuso de tiles: lo que tiene fb segun el ultimo rcFlush
+    bool reusarTiles = true;
+    HistorialTiles previo;
+    std::vector<int> tilesSucios;               // los que rasteriza este flush
+    long tilesDibujados = 0, tilesReusados = 0; // acumulados, para informar
+};
+
+inline void rcCrear(RasterizadorCPU& rc, int ancho, int alto, PoolHilos* pool) {
+    fbCrear(rc.fb, ancho, alto);
+    rc.tilesX = (ancho + TAM_TILE - 1) / TAM_TILE;
+    rc.tilesY = (alto + TAM_TILE - 1) / TAM_TILE;
+    rc.bins.assign((size_t)rc.tilesX * rc.tilesY, std::vector<uint32_t>());
+    rc.previo = HistorialTiles();
+    rc.previo.hash.assign(rc.bins.size(), 0);
+    rc.pool = pool;
+}
+
+// Para cuando fb deja de tener lo que dibujo el ultimo flush (o las texturas
+// a las que apuntaban sus primitivas ya no son las mismas)
+inline void rcInvalidarTiles(RasterizadorCPU& rc) { std::fill(rc.previo.hash.begin(), rc.previo.hash.end(), 0); }
+
+// El borrado se difiere a cada tile en rcFlush para hacerlo en paralelo
+inline void rcIniciarFrame(RasterizadorCPU& rc, const float fondo[3]) {
+    rc.prims.clear();
+    rc.bins.resize((size_t)rc.tilesX * rc.tilesY);   // tras el primer flush vienen del historial
+    for (auto& bin : rc.bins) bin.clear();
+    for (int i = 0; i < 3; i++) rc.fondo[i] = fondo[i];
+}
+
+inline void rcAgregar(RasterizadorCPU& rc, const PrimRaster& p) {
+    uint32_t indice = (uint32_t)rc.prims.size();
+    rc.prims.push_back(p);
+    for (int ty = p.y0 / TAM_TILE; ty <= p.y1 / TAM_TILE; ty++)
+        for (int tx = p.x0 / TAM_TILE; tx <= p.x1 / TAM_TILE; tx++)
+            rc.bins[ty * rc.tilesX + tx].push_back(indice);
+}
+
+inline void rcTriangulo(RasterizadorCPU& rc, const VerticeRaster& a, const VerticeRaster& b, const VerticeRaster& c,
+                        const float col[4], const TexturaCPU* tex) {
+    PrimRaster p;
+    if (!prepararTriangulo(p, a, b, c, rc.fb.ancho, rc.fb.alto)) return;
+    for (int i = 0; i < 4; i++) p.col[i] = col[i];
+    p.tex = (tex && !tex->texels.empty()) ? tex : nullptr;
+    p.lod = p.tex ? lodTriangulo(p.v, *p.tex) : 0.0f;
+    p.hash = rc.reusarTiles ? hashPrim(p) : 0;
+    rcAgregar(rc, p);
+}
+
+inline void rcLinea(RasterizadorCPU& rc, const VerticeRaster& a, const VerticeRaster& b, const float col[4]) {
+    PrimRaster p;
+    if (!prepararLinea(p, a, b, rc.fb.ancho, rc.fb.alto)) return;
+    for (int i = 0; i < 4; i++) p.col[i] = col[i];
+    p.tex = nullptr;
+    p.lod = 0.0f;
+    p.hash = rc.reusarTiles ? hashPrim(p) : 0;
+    rcAgregar(rc, p);
+}
+
+inline void rcRasterizarTile(RasterizadorCPU& rc, int t) {
+    ZONA_PERFIL("rcRasterizarTile");
+    Framebuffer& fb = rc.fb;
+    int tx0 = (t % rc.tilesX) * TAM_TILE, ty0 = (t / rc.tilesX) * TAM_TILE;
+    int tx1 = std::min(tx0 + TAM_TILE, fb.ancho) - 1, ty1 = std::min(ty0 + TAM_TILE, fb.alto) - 1;
+
+    uint32_t limpio = empaquetarRGBA(rc.fondo[0], rc.fondo[1], rc.fondo[2], 1.0f);
+    for (int y = ty0; y <= ty1; y++) {
+        std::fill(&fb.color[y * fb.ancho + tx0], &fb.color[y * fb.ancho + tx1] + 1, limpio);
+        std::fill(&fb.profundidad[y * fb.ancho + tx0], &fb.profundidad[y * fb.ancho + tx1] + 1, 1.0f);
+    }
+    for (uint32_t i : rc.bins[t]) {
+        const PrimRaster& p = rc.prims[i];
+        if (p.esLinea) rasterLineaEnTile(fb, p, tx0, ty0, tx1, ty1);
+        else rasterTrianguloEnTile(fb, p, tx0, ty0, tx1, ty1);
+    }
+}
+
+// Resumen de lo que va a quedar en el tile t; nunca 0
+inline uint64_t rcHashTile(const RasterizadorCPU& rc, int t) {
+    uint64_t h = hashPalabras(rc.fondo, sizeof(rc.fondo));
+    for (uint32_t i : rc.bins[t]) h = (h ^ rc.prims[i].hash) * 0xC4CEB9FE1A85EC53ull;
+    return h | 1;
+}
+
+// Lo que decide los pixeles, comparado byte a byte (lo mismo que mira hashPrim)
+inline bool primsIguales(const PrimRaster& a, const PrimRaster& b) {
+    if (a.esLinea != b.esLinea || a.tex != b.tex) return false;
+    if (memcmp(a.col, b.col, sizeof(a.col)) != 0 || memcmp(&a.lod, &b.lod, sizeof(a.lod)) != 0) return false;
+    return memcmp(a.v, b.v, (a.esLinea ? 2 : 3) * sizeof(VerticeRaster)) == 0;
+}
+
+// Confirma una coincidencia de rcHashTile contra lo que el historial dice que
+// se dibujo en el tile t
+inline bool rcMismoTile(const RasterizadorCPU& rc, int t) {
+    const HistorialTiles& h = rc.previo;
+    if (t >= (int)h.bins.size() || memcmp(rc.fondo, h.fondo, sizeof(rc.fondo)) != 0) return false;
+    const std::vector<uint32_t>& ahora = rc.bins[t];
+    const std::vector<uint32_t>& antes = h.bins[t];
+    if (ahora.size() != antes.size()) return false;
+    for (size_t i = 0; i < ahora.size(); i++)
+        if (!primsIguales(rc.prims[ahora[i]], h.prims[antes[i]])) return false;
+    return true;
+}
+
+// Rasteriza todo lo acumulado en el frame; despues fb tiene la imagen final.
+// Los tiles que quedarian igual que en el flush anterior no se tocan. Las
+// primitivas del frame pasan al historial (intercambio, sin copias).
+inline void rcFlush(RasterizadorCPU& rc) {
+    ZONA_PERFIL("rcFlush");
+    int numTiles = rc.tilesX * rc.tilesY;
+    if ((int)rc.previo.hash.size() != numTiles) rc.previo.hash.assign(numTiles, 0);
+    rc.tilesSucios.clear();
+    for (int t = 0; t < numTiles; t++) {
+        uint64_t h = rc.reusarTiles ? rcHashTile(rc, t) : 0;
+        if (h && h == rc.previo.hash[t] && rcMismoTile(rc, t)) continue;
+        rc.previo.hash[t] = h;
+        rc.tilesSucios.push_back(t);
+    }
+    int sucios = (int)rc.tilesSucios.size();
+    rc.tilesDibujados += sucios;
+    rc.tilesReusados += numTiles - sucios;
+    if (rc.pool) poolParaCada(*rc.pool, sucios, [&rc](int k) { rcRasterizarTile(rc, rc.tilesSucios[k]); });
+    else for (int k = 0; k < sucios; k++) rcRasterizarTile(rc, rc.tilesSucios[k]);
+    if (!rc.reusarTiles) return;
+    rc.prims.swap(rc.previo.prims);
+    rc.bins.swap(rc.previo.bins);
+    memcpy(rc.previo.fondo, rc.fondo, sizeof(rc.fondo));
+}
+
+// Guarda el framebuffer como PPM binario (P6), volteado para que la fila de
+// arriba de la imagen sea la de arriba de la pantalla
+inline int fbGuardarPPM(const Framebuffer& fb, const char* ruta) {
+    FILE* f = fopen(ruta, "wb");
+    if (!f) return 0;
+    fprintf(f, "P6\n%d %d\n255\n", fb.ancho, fb.alto);
+    std::vector<unsigned char> fila((size_t)fb.ancho * 3);
+    for (int y = fb.alto - 1; y >= 0; y--) {
+        const uint32_t* src = &fb.color[(size_t)y * fb.ancho];
+        for (int x = 0; x < fb.ancho; x++) {
+            fila[x * 3 + 0] = src[x] & 255; fila[x * 3 + 1] = (src[x] >> 8) & 255; fila[x * 3 + 2] = (src[x] >> 16) & 255;
+        }
+        fwrite(fila.data(), 1, fila.size(), f);
+    }
+    fclose(f);
+    return 1;
+}
+
+// Lee un PPM P6 de 8 bits como los de fbGuardarPPM (solo color, alfa = 255)
+inline int fbCargarPPM(Framebuffer& fb, const char* ruta) {
+    FILE* f = fopen(ruta, "rb");
+    if (!f) return 0;
+    int ancho = 0, alto = 0, maximo = 0;
+    if (fscanf(f, "P6 %d %d %d", &ancho, &alto, &maximo) != 3 || maximo != 255 || ancho <= 0 || alto <= 0) { fclose(f); return 0; }
+    fgetc(f);   // el unico blanco despues de la cabecera
+    fb.ancho = ancho; fb.alto = alto;
+    fb.color.assign((size_t)ancho * alto, 0);
+    std::vector<unsigned char> fila((size_t)ancho * 3);
+    for (int y = alto - 1; y >= 0; y--) {
+        if (fread(fila.data(), 1, fila.size(), f) != fila.size()) { fclose(f); return 0; }
+        uint32_t* dst = &fb.color[(size_t)y * ancho];
+        for (int x = 0; x < ancho; x++) dst[x] = fila[x * 3] | (fila[x * 3 + 1] << 8) | (fila[x * 3 + 2] << 16) | 0xFF000000u;
+    }
+    fclose(f);
+    return 1;
+}
@@ -0,0 +1,472 @@
+// recursos.h - Carga de imagenes en segundo plano con cache
+//
+// recPedirImagen() devuelve enseguida un identificador; hilos decodificadores
+// leen el archivo y lo decodifican con stb_image mientras la ventana ya
+// dibuja. recSubirListas(), llamado desde el hilo del contexto (una vez por
+// frame), crea las texturas de lo que ya se decodifico. Hasta entonces
+// recTextura() da 0 y quien dibuja usa el color de respaldo del recurso.
+//
+// Se deduplica dos veces: por ruta (pedir dos veces la misma imagen da el
+// mismo identificador) y por contenido (dos rutas con los mismos bytes
+// comparten la decodificacion y la textura).
+//
+// Los .ltex (textura_horneada.h) no se decodifican: se mapean y los texels
+// (con sus mipmaps, si el archivo trae la cadena completa) van directo del
+// mapeo al backend. No se les calcula hash de contenido,
+// que obligaria a leer todo el archivo; se deduplican solo por ruta.
+//
+// Con recUsarAtlas() las imagenes no reciben una textura cada una: lo que ya
+// se decodifico se empaqueta en paginas de atlas (atlas.h) y cada recurso
+// apunta a su pagina y a su rectangulo UV. Lo que llega despues va a paginas
+// nuevas, asi una imagen lenta o perdida no frena a las demas.
+//
+// Quien dibuja no toma el lock: recVista() lee una copia por hilo de lo que
+// hace falta para dibujar (textura, UV, respaldo), que se renueva solo cuando
+// sube la generacion del gestor, es decir cuando algo quedo listo.
+//
+// Incluir despues de stb_image.h y render.h.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "atlas.h"
+#include "perfil.h"
+#include "textura_horneada.h"
+
+typedef enum { REC_PENDIENTE, REC_DECODIFICADA, REC_LISTA, REC_FALLIDA } EstadoRecurso;
+
+struct Recurso {
+    std::string ruta;
+    EstadoRecurso estado = REC_PENDIENTE;
+    float respaldo[3] = {1.0f, 1.0f, 1.0f};
+    uint64_t hashContenido = 0;
+    int igualA = -1;                      // recurso con el mismo contenido que ya se decodifico
+    unsigned char* pixeles = nullptr;     // de stb_image, hasta que se sube
+    ArchivoMapeado mapeo;                 // .ltex: pixeles apunta dentro del mapeo
+    const unsigned char* texels = nullptr;   // lo que se sube: pixeles o el nivel 0 del mapeo
+    const uint32_t* nivelesLtex[LTEX_MAX_NIVELES] = {nullptr};   // cadena completa del .ltex, si la trae
+    int numNivelesLtex = 0;
+    std::chrono::steady_clock::time_point pedido;
+    int ancho = 0, alto = 0, canales = 0;
+    unsigned int textura = 0;
+    float uv[4] = {0.0f, 0.0f, 1.0f, 1.0f};   // rectangulo dentro de la textura (pagina del atlas)
+};
+
+struct GestorRecursos {
+    std::deque<Recurso> recursos;         // deque: las referencias no se mueven al crecer
+    std::map<std::string, int> porRuta;
+    std::map<uint64_t, int> porContenido;
+    std::deque<int> cola;                 // pendientes de decodificar
+    std::vector<std::thread> hilos;
+    std::mutex mtx;
+    std::condition_variable cv;
+    int sinSubir = 0;                     // pedidos que aun no terminaron (ni lista ni fallida)
+    bool cerrando = false;
+    int tamAtlas = 0;                     // lado maximo de pagina; 0 = una textura por imagen
+    std::vector<PaginaAtlas> paginas;     // solo las dimensiones: los texels se liberan al subir
+    std::atomic<int> generacion{0};       // sube (con el lock) cuando cambia la vista de algun recurso
+};
+
+// Lo que lee quien dibuja, copiado del gestor
+struct VistaRecurso {
+    unsigned int textura;
+    float uv[4];
+    float respaldo[3];
+};
+
+struct VistaRecursosHilo {
+    const GestorRecursos* gestor = nullptr;
+    int generacion = -1;
+    std::vector<VistaRecurso> recursos;
+};
+thread_local VistaRecursosHilo vistaRecursosHilo;
+
+// FNV-1a de 64 bits sobre los bytes del archivo
+inline uint64_t hashBytes(const unsigned char* p, size_t n) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+inline int leerArchivo(const char* ruta, std::vector<unsigned char>& bytes) {
+    FILE* f = fopen(ruta, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long largo = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bytes.resize(largo > 0 ? (size_t)largo : 0);
+    size_t leidos = bytes.empty() ? 0 : fread(bytes.data(), 1, bytes.size(), f);
+    fclose(f);
+    return largo > 0 && leidos == bytes.size();
+}
+
+inline int esLtex(const std::string& ruta) {
+    return ruta.size() > 5 && ruta.compare(ruta.size() - 5, 5, ".ltex") == 0;
+}
+
+// Termina un pedido sin textura (lo llama el decodificador con el lock tomado)
+inline void recFallar(GestorRecursos& g, Recurso& r) {
+    printf(">> ERROR: no se pudo cargar %s\n", r.ruta.c_str());
+    r.estado = REC_FALLIDA;
+    g.sinSubir--;
+    g.cv.notify_all();
+}
+
+inline void recMapearLtex(GestorRecursos& g, int id, const std::string& ruta) {
+    ArchivoMapeado m;
+    const CabeceraLtex* c = mapearArchivo(ruta.c_str(), m) ? validarLtex(m) : NULL;
+    std::lock_guard<std::mutex> lock(g.mtx);
+    Recurso& r = g.recursos[id];
+    if (!c) { desmapearArchivo(m); recFallar(g, r); return; }
+    r.mapeo = m;
+    r.texels = m.datos + c->desplazamiento[0];
+    r.ancho = c->ancho; r.alto = c->alto; r.canales = 4;
+    if ((int)c->niveles == nivelesCompletos(c->ancho, c->alto)) {   // si no, se generan al subir
+        for (uint32_t n = 0; n < c->niveles; n++) r.nivelesLtex[n] = (const uint32_t*)(m.datos + c->desplazamiento[n]);
+        r.numNivelesLtex = c->niveles;
+    }
+    r.estado = REC_DECODIFICADA;
+    g.cv.notify_all();
+}
+
+inline void recDecodificar(GestorRecursos& g, int id) {
+    ZONA_PERFIL("recDecodificar");
+    std::string ruta;
+    {
+        std::lock_guard<std::mutex> lock(g.mtx);
+        ruta = g.recursos[id].ruta;
+    }
+    if (esLtex(ruta)) { recMapearLtex(g, id, ruta); return; }
+    std::vector<unsigned char> bytes;
+    int ok = leerArchivo(ruta.c_str(), bytes);
+    uint64_t hash = ok ? hashBytes(bytes.data(), bytes.size()) : 0;
+    if (ok) {
+        std::lock_guard<std::mutex> lock(g.mtx);
+        Recurso& r = g.recursos[id];
+        r.hashContenido = hash;
+        auto it = g.porContenido.find(hash);
+        if (it != g.porContenido.end()) {  // mismos bytes que otra ruta: no se decodifica de nuevo
+            r.igualA = it->second;
+            r.estado = REC_DECODIFICADA;
+            g.cv.notify_all();
+            return;
+        }
+        g.porContenido[hash] = id;
+    }
+    int ancho = 0, alto = 0, canales = 0;
+    unsigned char* px = nullptr;
+    if (ok) {
+        stbi_set_flip_vertically_on_load_thread(1);
+        px = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &ancho, &alto, &canales, 0);
+    }
+    std::lock_guard<std::mutex> lock(g.mtx);
+    Recurso& r = g.recursos[id];
+    if (!px) { recFallar(g, r); return; }
+    r.pixeles = px; r.texels = px; r.ancho = ancho; r.alto = alto; r.canales = canales;
+    r.estado = REC_DECODIFICADA;
+    g.cv.notify_all();
+}
+
+inline void recBucleHilo(GestorRecursos* g) {
+    for (;;) {
+        int id;
+        {
+            std::unique_lock<std::mutex> lock(g->mtx);
+            g->cv.wait(lock, [&] { return !g->cola.empty() || g->cerrando; });
+            if (g->cola.empty()) return;
+            id = g->cola.front();
+            g->cola.pop_front();
+        }
+        recDecodificar(*g, id);
+    }
+}
+
+// n <= 0 usa 2 hilos: alcanza para que la ventana nunca espere
+inline void recIniciar(GestorRecursos& g, int n) {
+    if (n <= 0) n = 2;
+    for (int i = 0; i < n; i++) g.hilos.push_back(std::thread(recBucleHilo, &g));
+}
+
+inline void recLiberarPixeles(Recurso& r) {
+    if (r.pixeles) stbi_image_free(r.pixeles);
+    desmapearArchivo(r.mapeo);
+    r.pixeles = nullptr; r.texels = nullptr; r.numNivelesLtex = 0;
+}
+
+inline void recDetener(GestorRecursos& g) {
+    {
+        std::lock_guard<std::mutex> lock(g.mtx);
+        g.cerrando = true;
+        g.cola.clear();
+    }
+    g.cv.notify_all();
+    for (std::thread& h : g.hilos) h.join();
+    g.hilos.clear();
+    for (Recurso& r : g.recursos) recLiberarPixeles(r);
+}
+
+// Encola la imagen (si no estaba ya pedida) y devuelve su identificador
+inline int recPedirImagen(GestorRecursos& g, const char* ruta, const float respaldo[3]) {
+    std::lock_guard<std::mutex> lock(g.mtx);
+    auto it = g.porRuta.find(ruta);
+    if (it != g.porRuta.end()) return it->second;
+    int id = (int)g.recursos.size();
+    g.recursos.emplace_back();
+    Recurso& r = g.recursos.back();
+    r.ruta = ruta;
+    r.pedido = std::chrono::steady_clock::now();
+    for (int i = 0; i < 3; i++) r.respaldo[i] = respaldo[i];
+    g.porRuta[ruta] = id;
+    g.cola.push_back(id);
+    g.sinSubir++;
+    g.generacion++;
+    g.cv.notify_all();
+    return id;
+}
+
+// Vuelve a leer el archivo de un recurso terminado (cambio en disco). Hasta
+// que la nueva version se sube se sigue dibujando la anterior; al subirla, la
+// textura vieja se libera si ya no la usa nadie (recLiberarSinUso). Devuelve 0
+// si el recurso todavia esta en camino; entonces hay que volver a pedirlo despues.
+inline int recRecargar(GestorRecursos& g, int id) {
+    std::lock_guard<std::mutex> lock(g.mtx);
+    if (id < 0 || id >= (int)g.recursos.size()) return 1;
+    Recurso& r = g.recursos[id];
+    if (r.estado != REC_LISTA && r.estado != REC_FALLIDA) return 0;
+    auto it = g.porContenido.find(r.hashContenido);
+    if (it != g.porContenido.end() && it->second == id) g.porContenido.erase(it);   // el contenido viejo ya no es el suyo
+    r.estado = REC_PENDIENTE;
+    r.igualA = -1;
+    r.hashContenido = 0;
+    r.pedido = std::chrono::steady_clock::now();
+    g.cola.push_back(id);
+    g.sinSubir++;
+    g.cv.notify_all();
+    return 1;
+}
+
+// Empaquetar las imagenes en paginas de hasta tamMax x tamMax. Llamar antes del primer pedido
+inline void recUsarAtlas(GestorRecursos& g, int tamMax) {
+    std::lock_guard<std::mutex> lock(g.mtx);
+    g.tamAtlas = tamMax;
+}
+
+// Decodificada y, si es una copia por contenido, con el original ya resuelto
+inline bool recSubible(const GestorRecursos& g, const Recurso& r) {
+    if (r.estado != REC_DECODIFICADA) return false;
+    if (r.igualA < 0) return true;
+    EstadoRecurso o = g.recursos[r.igualA].estado;
+    return o == REC_LISTA || o == REC_FALLIDA;
+}
+
+inline bool recHayParaSubir(const GestorRecursos& g) {
+    for (const Recurso& r : g.recursos)
+        if (recSubible(g, r)) return true;
+    return false;
+}
+
+inline bool recHayPendientes(const GestorRecursos& g) {
+    for (const Recurso& r : g.recursos)
+        if (r.estado == REC_PENDIENTE) return true;
+    return false;
+}
+
+// Libera las texturas que una recarga dejo sin recurso: una pagina de atlas
+// o una copia por contenido pueden seguir usandola. Con el lock tomado, desde
+// el hilo que sube, antes de subir la generacion.
+inline void recLiberarSinUso(GestorRecursos& g, const std::vector<unsigned int>& viejas) {
+    for (size_t i = 0; i < viejas.size(); i++) {
+        unsigned int t = viejas[i];
+        bool enUso = t == 0;
+        for (size_t j = 0; j < i && !enUso; j++) enUso = viejas[j] == t;   // ya se libero
+        for (size_t j = 0; j < g.recursos.size() && !enUso; j++) enUso = g.recursos[j].textura == t;
+        if (!enUso) rLiberarTextura(t);
+    }
+}
+
+// Lo que recSubirAtlas lee de un recurso, copiado con el lock tomado
+struct EntradaAtlas {
+    int id;
+    const unsigned char* texels;
+    const uint32_t* niveles[LTEX_MAX_NIVELES];
+    int numNiveles, ancho, alto, canales;
+};
+
+// Empaqueta y sube lo decodificado (sin copias por contenido) en paginas nuevas.
+// Se llama con el lock tomado; lo suelta mientras arma y sube las paginas.
+inline void recSubirAtlas(GestorRecursos& g, std::unique_lock<std::mutex>& lock) {
+    std::vector<EntradaAtlas> entradas;
+    for (size_t i = 0; i < g.recursos.size(); i++) {
+        const Recurso& r = g.recursos[i];
+        if (r.estado != REC_DECODIFICADA || r.igualA >= 0) continue;
+        EntradaAtlas e;
+        e.id = (int)i; e.texels = r.texels;
+        memcpy(e.niveles, r.nivelesLtex, sizeof(e.niveles));
+        e.numNiveles = r.numNivelesLtex; e.ancho = r.ancho; e.alto = r.alto; e.canales = r.canales;
+        entradas.push_back(e);
+    }
+    if (entradas.empty()) return;
+    // Sin el lock no se lee el gestor: los pedidos nuevos mueven la tabla de la
+    // deque y recRecargar cambia recursos. Los texels siguen validos porque solo
+    // este hilo libera lo decodificado.
+    lock.unlock();
+    std::vector<std::vector<uint32_t>> rgba(entradas.size());
+    std::vector<ImagenAtlas> imgs;
+    std::vector<unsigned int> texturas;
+    size_t primera = g.paginas.size();
+    const EntradaAtlas& unico = entradas[0];
+    if (entradas.size() == 1 && unico.numNiveles) {
+        // pagina = imagen: se sube directo del mapeo, con los mipmaps horneados
+        ImagenAtlas img = { nullptr, unico.ancho, unico.alto, (int)primera, {0.0f, 0.0f, 1.0f, 1.0f} };
+        imgs.push_back(img);
+        g.paginas.emplace_back();
+        paginaIniciar(g.paginas.back(), unico.ancho, unico.alto);
+        texturas.push_back(rCrearTexturaNiveles(unico.niveles, unico.numNiveles, unico.ancho, unico.alto));
+    } else {
+        for (size_t k = 0; k < entradas.size(); k++) {
+            const EntradaAtlas& e = entradas[k];
+            rConvertirRGBA8(e.texels, e.ancho, e.alto, e.canales, rgba[k]);
+            ImagenAtlas img = { rgba[k].data(), e.ancho, e.alto, 0, {0.0f, 0.0f, 1.0f, 1.0f} };
+            imgs.push_back(img);
+        }
+        atlasEmpaquetar(g.paginas, imgs, g.tamAtlas);
+        for (size_t p = primera; p < g.paginas.size(); p++) {
+            PaginaAtlas& pag = g.paginas[p];
+            texturas.push_back(rCrearTextura((const unsigned char*)pag.texels.data(), pag.ancho, pag.alto, 4));
+            std::vector<uint32_t>().swap(pag.texels);
+        }
+    }
+    for (size_t p = primera; p < g.paginas.size(); p++)
+        printf(">> Pagina de atlas %d: %dx%d\n", (int)p, g.paginas[p].ancho, g.paginas[p].alto);
+    lock.lock();
+    std::vector<unsigned int> viejas;
+    for (size_t k = 0; k < entradas.size(); k++) {
+        Recurso& r = g.recursos[entradas[k].id];
+        viejas.push_back(r.textura);
+        r.textura = texturas[imgs[k].pagina - primera];
+        memcpy(r.uv, imgs[k].uv, sizeof(r.uv));
+        recLiberarPixeles(r);
+        r.estado = REC_LISTA;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r.pedido).count();
+        printf(">> Textura lista: %s (%dx%d en la pagina %d, %.2f ms desde el pedido)\n", r.ruta.c_str(), r.ancho, r.alto,
+               imgs[k].pagina, ms);
+        g.sinSubir--;
+    }
+    recLiberarSinUso(g, viejas);
+    g.generacion++;
+}
+
+// Crea las texturas de lo ya decodificado. Solo desde el hilo que dibuja
+// (el del contexto GL). Devuelve cuantas quedaron listas en esta llamada.
+inline int recSubirListas(GestorRecursos& g) {
+    ZONA_PERFIL("recSubirListas");
+    int subidas = 0;
+    std::unique_lock<std::mutex> lock(g.mtx);
+    if (!recHayParaSubir(g)) return 0;
+    std::vector<unsigned int> viejas;
+    if (g.tamAtlas > 0) {
+        int antes = g.sinSubir;
+        recSubirAtlas(g, lock);
+        subidas += antes - g.sinSubir;
+    }
+    for (size_t i = 0; i < g.recursos.size(); i++) {
+        Recurso& r = g.recursos[i];
+        if (!recSubible(g, r)) continue;
+        viejas.push_back(r.textura);
+        if (r.igualA >= 0) {                 // comparte la textura del original
+            const Recurso& o = g.recursos[r.igualA];
+            r.textura = o.textura;
+            memcpy(r.uv, o.uv, sizeof(r.uv));
+            r.estado = o.estado;
+        } else if (g.tamAtlas > 0) {
+            viejas.pop_back();
+            continue;                        // se decodifico mientras se armaba el atlas: va en la proxima tanda
+        } else {
+            lock.unlock();                   // la subida no toca el gestor; los decodificadores siguen
+            unsigned int t = r.numNivelesLtex ? rCrearTexturaNiveles(r.nivelesLtex, r.numNivelesLtex, r.ancho, r.alto)
+                                              : rCrearTextura(r.texels, r.ancho, r.alto, r.canales);
+            lock.lock();
+            r.textura = t;
+            recLiberarPixeles(r);
+            r.estado = REC_LISTA;
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r.pedido).count();
+            printf(">> Textura lista: %s (%dx%d, %.2f ms desde el pedido)\n", r.ruta.c_str(), r.ancho, r.alto, ms);
+        }
+        g.sinSubir--;
+        subidas++;
+    }
+    recLiberarSinUso(g, viejas);
+    if (subidas) g.generacion++;
+    return subidas;
+}
+
+// Bloquea hasta que todo lo pedido este listo o haya fallado (modos sin
+// ventana, que necesitan el mismo resultado en cada corrida). Con atlas no se
+// sube nada mientras quede algo por decodificar: todo va a las mismas paginas
+// en cada corrida, sin depender de que imagen termino primero.
+inline void recEsperarTodo(GestorRecursos& g) {
+    std::unique_lock<std::mutex> lock(g.mtx);
+    for (;;) {
+        g.cv.wait(lock, [&] {
+            return g.sinSubir == 0 || (recHayParaSubir(g) && !(g.tamAtlas > 0 && recHayPendientes(g)));
+        });
+        if (g.sinSubir == 0) return;
+        lock.unlock();
+        recSubirListas(g);
+        lock.lock();
+    }
+}
+
+// Vista del recurso para dibujar, sin lock mientras nada cambie (el lock se
+// toma solo para copiar todo de nuevo). NULL si el id no existe. Vale hasta la
+// proxima llamada desde el mismo hilo.
+inline const VistaRecurso* recVista(GestorRecursos& g, int id) {
+    VistaRecursosHilo& v = vistaRecursosHilo;
+    if (v.gestor != &g || v.generacion != g.generacion.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(g.mtx);
+        v.gestor = &g;
+        v.generacion = g.generacion.load(std::memory_order_relaxed);
+        v.recursos.resize(g.recursos.size());
+        for (size_t i = 0; i < g.recursos.size(); i++) {
+            const Recurso& r = g.recursos[i];
+            VistaRecurso& d = v.recursos[i];
+            d.textura = r.textura;
+            memcpy(d.uv, r.uv, sizeof(d.uv));
+            memcpy(d.respaldo, r.respaldo, sizeof(d.respaldo));
+        }
+    }
+    return (id >= 0 && id < (int)v.recursos.size()) ? &v.recursos[id] : NULL;
+}
+
+// 0 hasta que la textura este subida (o si la imagen no se pudo cargar)
+inline unsigned int recTextura(GestorRecursos& g, int id) {
+    const VistaRecurso* v = recVista(g, id);
+    return v ? v->textura : 0;
+}
+
+// Rectangulo UV del recurso dentro de su textura (todo 0..1 sin atlas)
+inline void recRegion(GestorRecursos& g, int id, float uv[4]) {
+    const VistaRecurso* v = recVista(g, id);
+    memcpy(uv, v ? v->uv : UV_COMPLETA, 4 * sizeof(float));
+}
+
+inline const float* recRespaldo(GestorRecursos& g, int id) {
+    static const float blanco[3] = {1.0f, 1.0f, 1.0f};
+    const VistaRecurso* v = recVista(g, id);
+    return v ? v->respaldo : blanco;
+}
+
+inline EstadoRecurso recEstado(GestorRecursos& g, int id) {
+    std::lock_guard<std::mutex> lock(g.mtx);
+    return g.recursos[id].estado;
+}
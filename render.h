@@ -0,0 +1,1007 @@
+// render.h - Capa de dibujo y backends de render intercambiables
+//
+// Las escenas dibujan con una API calcada de glBegin/glEnd (rBegin, rVertex2f,
+// rPushMatrix...). La capa lleva su propia pila de matrices y entrega cada
+// primitiva ya transformada al backend activo:
+//   - backendGL:  OpenGL inmediato sobre el contexto de GLFW
+//   - backendCPU: rasterizador por tiles multihilo (rasterizador.h), sin GPU
+// Lo que se envia entre rComenzarObjeto y rTerminarObjeto se graba y, si es
+// igual a lo del frame anterior, el backend puede repetir su resultado.
+// Incluir despues de glad/GLFW (salvo con SIN_GL).
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "rasterizador.h"
+
+typedef enum { R_TRIANGLES, R_QUADS, R_POLYGON, R_LINES } PrimitivaDibujo;
+
+// Transformacion afin 2D + desplazamiento en z: x' = a*x + c*y + tx, y' = b*x + d*y + ty
+typedef struct { float a, b, c, d, tx, ty, tz; } Matriz2D;
+
+// Malla retenida: rango de verticesMallas en espacio local, ya triangulado
+// (o pares de vertices si es de lineas). Se construye una vez al arrancar y
+// se dibuja con la matriz actual como transformacion de instancia.
+typedef struct { int esLineas; int primero, cantidad; } Malla;
+
+// Elemento de un lote: malla con su transformacion completa y el orden de
+// envio que le hubiera tocado dibujada por separado (ver rReservarOrden)
+typedef struct { int malla; Matriz2D t; int orden; } ElementoLote;
+
+// Los vertices llegan en coordenadas de escena: x,y en 0..100 y z en -10..10,
+// el mismo volumen que glOrtho(0,100,0,100,-10,10)
+typedef struct {
+    const char* nombre;
+    void (*iniciarFrame)(const float fondo[3]);
+    void (*primitiva)(PrimitivaDibujo prim, const VerticeRaster* v, int n, const float col[4]);
+    // 0 = sin textura. uv = {u0, v0, u1, v1}: las coordenadas 0..1 del
+    // vertice se llevan a ese rectangulo (un sprite dentro de una pagina del atlas)
+    void (*usarTextura)(unsigned int id, const float uv[4]);
+    // niveles[n] = texels RGBA8 del mip n (dimNivel(ancho, n) x dimNivel(alto, n))
+    unsigned int (*crearTextura)(const uint32_t* const* niveles, int numNiveles, int ancho, int alto);
+    // el id puede volver a salir de crearTextura
+    void (*liberarTextura)(unsigned int id);
+    void (*subirMallas)(const VerticeRaster* v, int n);
+    void (*malla)(const Malla& m, const Matriz2D& t, const float col[4]);
+    // n copias de la malla: cada una escalada (sx, sy), rotada angulo[i] (radianes)
+    // y trasladada a (x[i], y[i]) dentro de la matriz base
+    void (*instancias)(const Malla& m, const Matriz2D& base, float sx, float sy,
+                       const float* x, const float* y, const float* angulo, int n, const float col[4]);
+    // n copias de la malla, cada una con su propia matriz (base * t[i])
+    void (*instanciasMatriz)(const Malla& m, const Matriz2D& base, const Matriz2D* t, int n, const float col[4]);
+    // varias mallas distintas con un mismo color, en una sola tanda
+    void (*lote)(const ElementoLote* e, int n, const float col[4]);
+    void (*terminarFrame)();
+    // Objetos grabados (NULL = el backend no guarda nada y se le envia todo).
+    // repetirObjeto devuelve 1 si rehizo lo del objeto 'id' con esos mismos
+    // comandos (el hash descarta rapido; los bytes confirman); si no, recibe
+    // los comandos entre comenzarObjeto y terminarObjeto. Dentro de un objeto
+    // la z llega sin el sesgo de orden del objeto (ver rComenzarObjeto): el
+    // backend la aleja 'sesgo' al dibujar. terminarObjeto con id -1 no guarda
+    // nada (--sin-reuso).
+    int (*repetirObjeto)(int id, uint64_t hash, const unsigned char* comandos, size_t bytes, float sesgo);
+    void (*comenzarObjeto)(int id, float sesgo);
+    void (*terminarObjeto)(int id, uint64_t hash, const unsigned char* comandos, size_t bytes);
+} BackendRender;
+
+#define MAX_PILA_MATRICES 32
+#define MAX_VERTICES_PRIM 64
+
+BackendRender* backendActual = NULL;
+int anchoVista = 800, altoVista = 600;     // pixeles del viewport, para estimar tamanos en pantalla
+
+// El estado de envio (pila, color, primitiva en curso) es de cada hilo: la
+// exportacion en paralelo dibuja un frame distinto en cada uno
+thread_local Matriz2D pilaMatrices[MAX_PILA_MATRICES];
+thread_local int topeMatriz = 0;
+thread_local float colorActual[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+thread_local float texCoordActual[2] = {0.0f, 0.0f};
+
+thread_local PrimitivaDibujo primActual = R_TRIANGLES;
+thread_local VerticeRaster verticesPrim[MAX_VERTICES_PRIM];
+thread_local float colorPrim[4];
+thread_local int numVerticesPrim = 0;
+
+// Cada envio del frame se aleja SESGO_ORDEN en z respecto del anterior (muy
+// por debajo del 0.1 que separa las capas de la escena). Asi, a igual z, sigue
+// ganando lo enviado antes, como con GL_LESS, aunque un lote reordene piezas.
+#define SESGO_ORDEN 1e-5f
+thread_local int ordenEnvio = 0;
+
+// Cada color pedido (y el fondo) pasa por c * mul + suma antes de llegar al
+// backend. Es por hilo: en el modo servidor cada sesion dibuja con su paleta
+// sobre las mismas mallas. El neutro deja los colores bit a bit iguales.
+typedef struct { float mul[3], suma[3]; } FiltroColor;
+const FiltroColor FILTRO_NEUTRO = { {1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f} };
+thread_local FiltroColor filtroColor = FILTRO_NEUTRO;
+
+std::vector<VerticeRaster> verticesMallas;
+std::vector<Malla> mallas;
+int grabandoMalla = 0;
+Malla mallaEnCurso;
+
+// --- OBJETOS GRABADOS ---
+// Entre rComenzarObjeto(id) y rTerminarObjeto() lo que se envia no llega al
+// backend: se graba en un buffer de comandos del hilo (cabecera y datos
+// seguidos, todo de a 4 bytes) que al terminar se resume en un hash. Si el
+// backend todavia tiene lo que produjo el objeto 'id' con ese mismo hash lo
+// repite; si no, se le reproduce el buffer. La escena se recorre igual (es lo
+// que arma los comandos): lo que se ahorra es el trabajo del backend.
+
+typedef enum { CMD_PRIMITIVA, CMD_TEXTURA, CMD_MALLA, CMD_INSTANCIAS, CMD_INSTANCIAS_MATRIZ, CMD_LOTE } ComandoDibujo;
+
+// n: vertices, instancias o elementos; extra: la primitiva o el id de textura
+typedef struct { uint32_t comando; int32_t n; uint32_t extra; } CabeceraComando;
+
+int reusoDibujo = 1;                          // 0: todo se envia directo (--sin-reuso)
+int generacionRender = 0;                     // sube al crear o liberar texturas y al subir mallas: lo guardado deja de valer
+thread_local int objetoEnCurso = -1;          // -1 = no se esta grabando
+thread_local int objetoDirecto = -1;          // objeto que va directo al backend (--sin-reuso)
+thread_local int ordenBaseObjeto = 0;         // ordenEnvio al empezar el objeto en curso
+thread_local std::vector<unsigned char> comandosObjeto;
+thread_local long objetosGrabados = 0, objetosRepetidos = 0;
+
+void grabar(const void* datos, size_t bytes) {
+    const unsigned char* p = (const unsigned char*)datos;
+    comandosObjeto.insert(comandosObjeto.end(), p, p + bytes);
+}
+
+void grabarCabecera(ComandoDibujo c, int n, uint32_t extra) {
+    CabeceraComando cab = { (uint32_t)c, n, extra };
+    grabar(&cab, sizeof(cab));
+}
+
+void grabPrimitiva(PrimitivaDibujo prim, const VerticeRaster* v, int n, const float col[4]) {
+    grabarCabecera(CMD_PRIMITIVA, n, (uint32_t)prim);
+    grabar(col, 4 * sizeof(float));
+    grabar(v, n * sizeof(VerticeRaster));
+}
+
+void grabUsarTextura(unsigned int id, const float uv[4]) {
+    grabarCabecera(CMD_TEXTURA, uv ? 1 : 0, id);
+    if (uv) grabar(uv, 4 * sizeof(float));
+}
+
+void grabMalla(const Malla& m, const Matriz2D& t, const float col[4]) {
+    grabarCabecera(CMD_MALLA, 1, 0);
+    grabar(&m, sizeof(m)); grabar(&t, sizeof(t)); grabar(col, 4 * sizeof(float));
+}
+
+void grabInstancias(const Malla& m, const Matriz2D& base, float sx, float sy,
+                    const float* x, const float* y, const float* angulo, int n, const float col[4]) {
+    float escala[2] = { sx, sy };
+    grabarCabecera(CMD_INSTANCIAS, n, 0);
+    grabar(&m, sizeof(m)); grabar(&base, sizeof(base)); grabar(escala, sizeof(escala)); grabar(col, 4 * sizeof(float));
+    grabar(x, n * sizeof(float)); grabar(y, n * sizeof(float)); grabar(angulo, n * sizeof(float));
+}
+
+void grabInstanciasMatriz(const Malla& m, const Matriz2D& base, const Matriz2D* t, int n, const float col[4]) {
+    grabarCabecera(CMD_INSTANCIAS_MATRIZ, n, 0);
+    grabar(&m, sizeof(m)); grabar(&base, sizeof(base)); grabar(col, 4 * sizeof(float));
+    grabar(t, n * sizeof(Matriz2D));
+}
+
+void grabLote(const ElementoLote* e, int n, const float col[4]) {
+    grabarCabecera(CMD_LOTE, n, 0);
+    grabar(col, 4 * sizeof(float));
+    grabar(e, n * sizeof(ElementoLote));
+}
+
+// Solo los envios de dibujo pasan por aca
+BackendRender backendGrabador = { "grabador", NULL, grabPrimitiva, grabUsarTextura, NULL, NULL, NULL, grabMalla,
+                                  grabInstancias, grabInstanciasMatriz, grabLote, NULL, NULL, NULL, NULL };
+
+// A quien van los envios de dibujo de este hilo
+BackendRender* destino() { return objetoEnCurso >= 0 ? &backendGrabador : backendActual; }
+
+const unsigned char* leerComando(const unsigned char* p, void* destino, size_t bytes) {
+    memcpy(destino, p, bytes);
+    return p + bytes;
+}
+
+// Envia los comandos grabados a 'b'. Los arreglos se pasan apuntando dentro
+// del buffer: todo quedo alineado a 4 bytes.
+void reproducirComandos(BackendRender* b, const unsigned char* p, const unsigned char* fin) {
+    while (p < fin) {
+        CabeceraComando cab;
+        float col[4], uv[4], escala[2];
+        Malla m;
+        Matriz2D t;
+        p = leerComando(p, &cab, sizeof(cab));
+        switch (cab.comando) {
+            case CMD_PRIMITIVA:
+                p = leerComando(p, col, sizeof(col));
+                b->primitiva((PrimitivaDibujo)cab.extra, (const VerticeRaster*)p, cab.n, col);
+                p += cab.n * sizeof(VerticeRaster);
+                break;
+            case CMD_TEXTURA:
+                if (cab.n) p = leerComando(p, uv, sizeof(uv));
+                b->usarTextura(cab.extra, cab.n ? uv : NULL);
+                break;
+            case CMD_MALLA:
+                p = leerComando(p, &m, sizeof(m)); p = leerComando(p, &t, sizeof(t)); p = leerComando(p, col, sizeof(col));
+                b->malla(m, t, col);
+                break;
+            case CMD_INSTANCIAS: {
+                p = leerComando(p, &m, sizeof(m)); p = leerComando(p, &t, sizeof(t));
+                p = leerComando(p, escala, sizeof(escala)); p = leerComando(p, col, sizeof(col));
+                const float* x = (const float*)p;
+                b->instancias(m, t, escala[0], escala[1], x, x + cab.n, x + 2 * cab.n, cab.n, col);
+                p += 3 * cab.n * sizeof(float);
+                break;
+            }
+            case CMD_INSTANCIAS_MATRIZ:
+                p = leerComando(p, &m, sizeof(m)); p = leerComando(p, &t, sizeof(t)); p = leerComando(p, col, sizeof(col));
+                b->instanciasMatriz(m, t, (const Matriz2D*)p, cab.n, col);
+                p += cab.n * sizeof(Matriz2D);
+                break;
+            case CMD_LOTE:
+                p = leerComando(p, col, sizeof(col));
+                b->lote((const ElementoLote*)p, cab.n, col);
+                p += cab.n * sizeof(ElementoLote);
+                break;
+        }
+    }
+}
+
+// --- PILA DE MATRICES ---
+
+void rLoadIdentity() {
+    Matriz2D identidad = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
+    topeMatriz = 0;
+    pilaMatrices[0] = identidad;
+}
+
+void rPushMatrix() {
+    if (topeMatriz + 1 >= MAX_PILA_MATRICES) { printf(">> ERROR: pila de matrices llena\n"); return; }
+    pilaMatrices[topeMatriz + 1] = pilaMatrices[topeMatriz];
+    topeMatriz++;
+}
+
+void rPopMatrix() { if (topeMatriz > 0) topeMatriz--; }
+
+void rTranslatef(float x, float y, float z) {
+    Matriz2D& m = pilaMatrices[topeMatriz];
+    m.tx += m.a * x + m.c * y; m.ty += m.b * x + m.d * y; m.tz += z;
+}
+
+// Solo rotaciones sobre el eje z, que es lo unico que usa la escena 2D
+void rRotatef(float grados, float, float, float) {
+    Matriz2D& m = pilaMatrices[topeMatriz];
+    float rad = grados * 3.14159265f / 180.0f;
+    float c = cosf(rad), s = sinf(rad);
+    Matriz2D r = m;
+    m.a = r.a * c + r.c * s; m.b = r.b * c + r.d * s;
+    m.c = r.c * c - r.a * s; m.d = r.d * c - r.b * s;
+}
+
+void rScalef(float sx, float sy, float) {
+    Matriz2D& m = pilaMatrices[topeMatriz];
+    m.a *= sx; m.b *= sx; m.c *= sy; m.d *= sy;
+}
+
+// --- ESTADO Y PRIMITIVAS ---
+
+void rFiltroColor(const FiltroColor& f) { filtroColor = f; }
+
+void rColor4f(float r, float g, float b, float a) {
+    colorActual[0] = r * filtroColor.mul[0] + filtroColor.suma[0];
+    colorActual[1] = g * filtroColor.mul[1] + filtroColor.suma[1];
+    colorActual[2] = b * filtroColor.mul[2] + filtroColor.suma[2];
+    colorActual[3] = a;
+}
+void rColor3f(float r, float g, float b) { rColor4f(r, g, b, 1.0f); }
+void rColor3fv(const float c[3]) { rColor4f(c[0], c[1], c[2], 1.0f); }
+void rTexCoord2f(float u, float v) { texCoordActual[0] = u; texCoordActual[1] = v; }
+
+// Ultima textura pedida por este hilo: repetir la misma (otro sprite de la
+// misma pagina con el mismo rectangulo, o volver a deshabilitar) no llega al backend
+#define TEXTURA_DESCONOCIDA 0xFFFFFFFFu
+const float UV_COMPLETA[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+thread_local unsigned int texturaEnUso = TEXTURA_DESCONOCIDA;
+thread_local float uvEnUso[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+
+void rEnableTextura(unsigned int id, const float uv[4]) {
+    if (!uv) uv = UV_COMPLETA;
+    if (id == texturaEnUso && memcmp(uv, uvEnUso, sizeof(uvEnUso)) == 0) return;
+    texturaEnUso = id;
+    memcpy(uvEnUso, uv, sizeof(uvEnUso));
+    destino()->usarTextura(id, uv);
+}
+void rDisableTextura() {
+    if (texturaEnUso == 0) return;
+    texturaEnUso = 0;
+    destino()->usarTextura(0, NULL);
+}
+
+// --- TEXTURAS ---
+
+typedef struct { unsigned int id; int ancho, alto, niveles; size_t bytes; } InfoTextura;
+
+std::vector<InfoTextura> texturasCreadas;    // para el informe de memoria
+
+// Con la cadena completa ya armada (p.ej. mapeada de un .ltex)
+unsigned int rCrearTexturaNiveles(const uint32_t* const* niveles, int numNiveles, int ancho, int alto) {
+    unsigned int id = backendActual->crearTextura(niveles, numNiveles, ancho, alto);
+    texturaEnUso = TEXTURA_DESCONOCIDA;   // crear cambia el bind (GL) o la textura activa (CPU)
+    generacionRender++;
+    size_t bytes = 0;
+    for (int n = 0; n < numNiveles; n++) bytes += (size_t)dimNivel(ancho, n) * dimNivel(alto, n) * 4;
+    InfoTextura info = { id, ancho, alto, numNiveles, bytes };
+    texturasCreadas.push_back(info);
+    return id;
+}
+
+// Cuando ya nadie la dibuja (una recarga la reemplazo). Desde el hilo que
+// crea las texturas y entre frames, como rCrearTexturaNiveles.
+void rLiberarTextura(unsigned int id) {
+    if (id == 0) return;
+    backendActual->liberarTextura(id);
+    if (texturaEnUso == id) texturaEnUso = TEXTURA_DESCONOCIDA;
+    generacionRender++;
+    for (size_t i = 0; i < texturasCreadas.size(); i++)
+        if (texturasCreadas[i].id == id) { texturasCreadas.erase(texturasCreadas.begin() + i); break; }
+}
+
+// Imagen de 1 a 4 canales -> RGBA8
+void rConvertirRGBA8(const unsigned char* datos, int ancho, int alto, int canales, std::vector<uint32_t>& rgba) {
+    rgba.resize((size_t)ancho * alto);
+    if (canales == 4) { memcpy(rgba.data(), datos, rgba.size() * 4); return; }   // ya es RGBA8 (little endian)
+    for (size_t i = 0; i < rgba.size(); i++) {
+        const unsigned char* p = datos + i * canales;
+        rgba[i] = canales >= 3 ? p[0] | (p[1] << 8) | (p[2] << 16) | (255u << 24)
+                               : p[0] * 0x010101u | ((canales == 2 ? p[1] : 255u) << 24);
+    }
+}
+
+// Imagen de 1 a 4 canales (fila 0 abajo): se pasa a RGBA8 y se le generan los mipmaps
+unsigned int rCrearTextura(const unsigned char* datos, int ancho, int alto, int canales) {
+    std::vector<uint32_t> base, cadena;
+    rConvertirRGBA8(datos, ancho, alto, canales, base);
+    size_t inicio[MAX_NIVELES_MIP];
+    int n = generarMipmaps(base.data(), ancho, alto, cadena, inicio);
+    const uint32_t* niveles[MAX_NIVELES_MIP];
+    for (int i = 0; i < n; i++) niveles[i] = &cadena[inicio[i]];
+    return rCrearTexturaNiveles(niveles, n, ancho, alto);
+}
+
+size_t rMemoriaTexturas() {
+    size_t total = 0;
+    for (const InfoTextura& t : texturasCreadas) total += t.bytes;
+    return total;
+}
+
+void rInformeTexturas() {
+    printf(">> TEXTURAS\n   %10s %11s %8s %10s %10s\n", "id", "tamano", "niveles", "base KB", "total KB");
+    for (const InfoTextura& t : texturasCreadas)
+        printf("   %10u %5dx%-5d %8d %10.1f %10.1f\n", t.id, t.ancho, t.alto, t.niveles,
+               t.ancho * t.alto * 4 / 1024.0, t.bytes / 1024.0);
+    printf(">> Memoria de texturas: %.1f KB (%s)\n", rMemoriaTexturas() / 1024.0, backendActual ? backendActual->nombre : "-");
+}
+
+void rBegin(PrimitivaDibujo prim) { primActual = prim; numVerticesPrim = 0; }
+
+// Los vertices se guardan ya transformados al espacio de la escena (0..100)
+void rVertex2f(float x, float y) {
+    if (numVerticesPrim >= MAX_VERTICES_PRIM) return;
+    if (numVerticesPrim == 0) memcpy(colorPrim, colorActual, sizeof(colorPrim));
+    const Matriz2D& m = pilaMatrices[topeMatriz];
+    VerticeRaster v = { m.a * x + m.c * y + m.tx, m.b * x + m.d * y + m.ty, m.tz, texCoordActual[0], texCoordActual[1] };
+    verticesPrim[numVerticesPrim++] = v;
+}
+
+void grabarPrimitiva();
+
+// Reserva n numeros de orden consecutivos y devuelve el primero
+int rReservarOrden(int n) { int r = ordenEnvio; ordenEnvio += n; return r; }
+
+float sesgoOrden(int orden) { return orden * SESGO_ORDEN; }
+
+void rEnd() {
+    if (grabandoMalla) { grabarPrimitiva(); return; }
+    float sesgo = sesgoOrden(rReservarOrden(1));
+    for (int i = 0; i < numVerticesPrim; i++) verticesPrim[i].z -= sesgo;
+    destino()->primitiva(primActual, verticesPrim, numVerticesPrim, colorPrim);
+}
+
+void rRectf(float x0, float y0, float x1, float y1) {
+    rBegin(R_QUADS);
+    rVertex2f(x0, y0); rVertex2f(x1, y0); rVertex2f(x1, y1); rVertex2f(x0, y1);
+    rEnd();
+}
+
+// Limpia color y profundidad y deja la matriz identidad
+void rIniciarFrame(const float fondo[3]) {
+    rLoadIdentity();
+    ordenEnvio = 0;
+    float f[3];
+    for (int i = 0; i < 3; i++) f[i] = fondo[i] * filtroColor.mul[i] + filtroColor.suma[i];
+    backendActual->iniciarFrame(f);
+}
+
+void rTerminarFrame() { backendActual->terminarFrame(); }
+
+// --- MALLAS RETENIDAS ---
+// Entre rComenzarMalla y rTerminarMalla los rBegin/rEnd no dibujan: sus
+// vertices (con la matriz actual ya aplicada) se acumulan en la malla.
+
+void rComenzarMalla() {
+    grabandoMalla = 1;
+    mallaEnCurso.esLineas = -1;
+    mallaEnCurso.primero = (int)verticesMallas.size();
+    rLoadIdentity();
+}
+
+void grabarPrimitiva() {
+    int esLineas = (primActual == R_LINES);
+    if (mallaEnCurso.esLineas != -1 && mallaEnCurso.esLineas != esLineas) {
+        printf(">> ERROR: una malla no puede mezclar lineas y triangulos\n");
+        return;
+    }
+    mallaEnCurso.esLineas = esLineas;
+    const VerticeRaster* v = verticesPrim;
+    int n = numVerticesPrim;
+    switch (primActual) {
+        case R_TRIANGLES:
+        case R_LINES:
+            verticesMallas.insert(verticesMallas.end(), v, v + n - n % (esLineas ? 2 : 3));
+            break;
+        case R_QUADS:
+            for (int i = 0; i + 3 < n; i += 4) {
+                VerticeRaster t[6] = { v[i], v[i+1], v[i+2], v[i], v[i+2], v[i+3] };
+                verticesMallas.insert(verticesMallas.end(), t, t + 6);
+            }
+            break;
+        case R_POLYGON:
+            for (int i = 1; i + 1 < n; i++) {
+                VerticeRaster t[3] = { v[0], v[i], v[i+1] };
+                verticesMallas.insert(verticesMallas.end(), t, t + 3);
+            }
+            break;
+    }
+}
+
+int rTerminarMalla() {
+    grabandoMalla = 0;
+    mallaEnCurso.cantidad = (int)verticesMallas.size() - mallaEnCurso.primero;
+    if (mallaEnCurso.esLineas == -1) mallaEnCurso.esLineas = 0;
+    mallas.push_back(mallaEnCurso);
+    return (int)mallas.size() - 1;
+}
+
+// Se llama una vez, despues de construir todas las mallas
+void rSubirMallas() {
+    backendActual->subirMallas(verticesMallas.data(), (int)verticesMallas.size());
+    generacionRender++;
+}
+
+// Dibuja la malla con la matriz actual (escalada por sx, sy) y el color actual
+void rDibujarMallaEscalada(int id, float sx, float sy) {
+    Matriz2D t = pilaMatrices[topeMatriz];
+    t.a *= sx; t.b *= sx; t.c *= sy; t.d *= sy;
+    t.tz -= sesgoOrden(rReservarOrden(1));
+    destino()->malla(mallas[id], t, colorActual);
+}
+
+const Matriz2D& rMatrizActual() { return pilaMatrices[topeMatriz]; }
+
+// Tamano en pixeles del semieje mayor de un objeto de semiejes (sx, sy)
+// dibujado con la matriz m
+float radioEnPantalla(const Matriz2D& m, float sx, float sy) {
+    float kx = anchoVista / 100.0f, ky = altoVista / 100.0f;
+    float ex = sqrtf((m.a * kx) * (m.a * kx) + (m.b * ky) * (m.b * ky)) * sx;
+    float ey = sqrtf((m.c * kx) * (m.c * kx) + (m.d * ky) * (m.d * ky)) * sy;
+    return ex > ey ? ex : ey;
+}
+
+float rRadioEnPantalla(float sx, float sy) { return radioEnPantalla(pilaMatrices[topeMatriz], sx, sy); }
+
+void rViewport(int ancho, int alto) { anchoVista = ancho; altoVista = alto; }
+
+void rDibujarMalla(int id) { rDibujarMallaEscalada(id, 1.0f, 1.0f); }
+
+// Lote de instancias de una malla con el color actual; los arreglos x, y,
+// angulo van separados (SoA) tal como los guarda la escena
+void rDibujarInstancias(int id, float sx, float sy, const float* x, const float* y, const float* angulo, int n) {
+    if (n <= 0) return;
+    Matriz2D base = pilaMatrices[topeMatriz];
+    base.tz -= sesgoOrden(rReservarOrden(1));
+    destino()->instancias(mallas[id], base, sx, sy, x, y, angulo, n, colorActual);
+}
+
+// Lote de mallas con el color actual. Los elementos traen su numero de orden
+// (de rReservarOrden), asi pueden llegar agrupados en cualquier orden.
+void rDibujarLote(ElementoLote* e, int n) {
+    if (n <= 0) return;
+    for (int i = 0; i < n; i++) e[i].t.tz -= sesgoOrden(e[i].orden);
+    destino()->lote(e, n, colorActual);
+}
+
+// Lote de instancias con una matriz completa por copia (p.ej. la misma pieza
+// de muchos rigs), relativas a la matriz actual
+void rDibujarInstanciasMatriz(int id, const Matriz2D* t, int n) {
+    if (n <= 0) return;
+    Matriz2D base = pilaMatrices[topeMatriz];
+    base.tz -= sesgoOrden(rReservarOrden(1));
+    destino()->instanciasMatriz(mallas[id], base, t, n, colorActual);
+}
+
+// Los objetos no se anidan. Empiezan y terminan sin textura, asi lo grabado
+// no depende de lo que se dibujo antes. Tampoco depende de cuanto se envio
+// antes: el orden se cuenta desde 0 dentro del objeto y el sesgo del primer
+// numero que le toca lo aplica el backend. Con --sin-reuso se hace igual,
+// sin grabar, para que la imagen sea la misma bit a bit.
+void rComenzarObjeto(int id) {
+    if (!backendActual->repetirObjeto || grabandoMalla || objetoEnCurso >= 0 || objetoDirecto >= 0) return;
+    rDisableTextura();
+    ordenBaseObjeto = ordenEnvio;
+    ordenEnvio = 0;
+    if (!reusoDibujo) {
+        objetoDirecto = id;
+        backendActual->comenzarObjeto(id, sesgoOrden(ordenBaseObjeto));
+        return;
+    }
+    objetoEnCurso = id;
+    comandosObjeto.clear();
+}
+
+void rTerminarObjeto() {
+    if (objetoDirecto >= 0) {
+        objetoDirecto = -1;
+        backendActual->terminarObjeto(-1, 0, NULL, 0);
+    } else if (objetoEnCurso >= 0) {
+        int id = objetoEnCurso;
+        objetoEnCurso = -1;
+        uint64_t hash = hashPalabras(comandosObjeto.data(), comandosObjeto.size());
+        float sesgo = sesgoOrden(ordenBaseObjeto);
+        objetosGrabados++;
+        if (backendActual->repetirObjeto(id, hash, comandosObjeto.data(), comandosObjeto.size(), sesgo)) objetosRepetidos++;
+        else {
+            backendActual->comenzarObjeto(id, sesgo);
+            reproducirComandos(backendActual, comandosObjeto.data(), comandosObjeto.data() + comandosObjeto.size());
+            backendActual->terminarObjeto(id, hash, comandosObjeto.data(), comandosObjeto.size());
+        }
+    } else return;
+    ordenEnvio += ordenBaseObjeto;
+    texturaEnUso = TEXTURA_DESCONOCIDA;   // si se repitio, el backend no vio los cambios de textura
+    rDisableTextura();
+}
+
+// p * h (h se aplica primero)
+Matriz2D multiplicarMatriz(const Matriz2D& p, const Matriz2D& h) {
+    Matriz2D m = { p.a * h.a + p.c * h.b, p.b * h.a + p.d * h.b,
+                   p.a * h.c + p.c * h.d, p.b * h.c + p.d * h.d,
+                   p.tx + (p.a * h.tx + p.c * h.ty), p.ty + (p.b * h.tx + p.d * h.ty), p.tz + h.tz };
+    return m;
+}
+
+// base * traslacion(x, y) * rotacion(angulo) * escala(sx, sy), igual que la pila
+Matriz2D componerInstancia(const Matriz2D& base, float x, float y, float angulo, float sx, float sy) {
+    float c = cosf(angulo), s = sinf(angulo);
+    Matriz2D m = base;
+    m.tx += base.a * x + base.c * y; m.ty += base.b * x + base.d * y;
+    m.a = base.a * c + base.c * s; m.b = base.b * c + base.d * s;
+    m.c = base.c * c - base.a * s; m.d = base.d * c - base.b * s;
+    m.a *= sx; m.b *= sx; m.c *= sy; m.d *= sy;
+    return m;
+}
+
+// --- BACKEND CPU ---
+
+thread_local RasterizadorCPU rasterCPU;       // cada hilo que dibuja tiene el suyo
+PoolHilos poolRaster;
+std::vector<TexturaCPU> texturasCPU;          // id de textura = indice + 1; ancho 0 = liberada
+thread_local const TexturaCPU* texturaCPUActiva = NULL;
+thread_local float uvCPUActiva[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+int cpuPresentarEnVentana = 0;                // copiar el frame al contexto GL al terminar
+
+// Escena (0..100, z en -10..10) -> ventana, igual que glOrtho(0,100,0,100,-10,10) + glViewport
+VerticeRaster aVentana(const VerticeRaster& v, const Framebuffer& fb) {
+    VerticeRaster r = { v.x * fb.ancho / 100.0f, v.y * fb.alto / 100.0f, 0.5f - v.z / 20.0f, v.u, v.v };
+    return r;
+}
+
+// Las primitivas que produjo cada objeto grabado la ultima vez que se
+// dibujo (por hilo, como rasterCPU), sin el sesgo de orden del objeto, y los
+// comandos de los que salieron. Apuntan a texturasCPU: valen mientras no
+// cambie generacionRender.
+struct ObjetoCPU {
+    uint64_t hash = 0;
+    int generacion = -1, ancho = 0, alto = 0;
+    std::vector<unsigned char> comandos;
+    std::vector<PrimRaster> prims;
+};
+thread_local std::vector<ObjetoCPU> objetosCPU;
+thread_local size_t inicioObjetoCPU = 0;
+thread_local float sesgoObjetoCPU = 0.0f;
+
+// Aleja la primitiva 'sesgo' (en z de escena, como sesgoOrden) en la
+// profundidad de ventana de aVentana. El hash de tile la ve con el sesgo.
+void cpuAplicarSesgo(PrimRaster& p, float sesgo) {
+    float dz = sesgo / 20.0f;
+    for (int i = 0; i < (p.esLinea ? 2 : 3); i++) p.v[i].z += dz;
+    if (!p.esLinea) p.zPlana = (p.v[0].z == p.v[1].z && p.v[1].z == p.v[2].z);
+    if (p.hash) p.hash = hashPalabras(&dz, sizeof(dz), p.hash);
+}
+
+void cpuIniciarFrame(const float fondo[3]) {
+    rasterCPU.reusarTiles = reusoDibujo != 0;
+    HistorialTiles& h = rasterCPU.previo;
+    if (h.generacion != generacionRender) { rcInvalidarTiles(rasterCPU); h.generacion = generacionRender; }
+    rcIniciarFrame(rasterCPU, fondo);
+}
+
+// Como rcMismoTile con los tiles: un hash igual se confirma con los bytes
+int cpuRepetirObjeto(int id, uint64_t hash, const unsigned char* comandos, size_t bytes, float sesgo) {
+    if (id < 0 || id >= (int)objetosCPU.size()) return 0;
+    const ObjetoCPU& o = objetosCPU[id];
+    if (o.hash != hash || o.generacion != generacionRender || o.ancho != rasterCPU.fb.ancho || o.alto != rasterCPU.fb.alto)
+        return 0;
+    if (o.comandos.size() != bytes || memcmp(o.comandos.data(), comandos, bytes) != 0) return 0;
+    for (PrimRaster p : o.prims) { cpuAplicarSesgo(p, sesgo); rcAgregar(rasterCPU, p); }
+    return 1;
+}
+
+void cpuComenzarObjeto(int, float sesgo) { inicioObjetoCPU = rasterCPU.prims.size(); sesgoObjetoCPU = sesgo; }
+
+// Se guarda antes de aplicar el sesgo, que es lo unico que cambia si el
+// objeto se repite en otro lugar del orden de envio
+void cpuTerminarObjeto(int id, uint64_t hash, const unsigned char* comandos, size_t bytes) {
+    if (id >= 0) {
+        if (id >= (int)objetosCPU.size()) objetosCPU.resize(id + 1);
+        ObjetoCPU& o = objetosCPU[id];
+        o.hash = hash; o.generacion = generacionRender;
+        o.comandos.assign(comandos, comandos + bytes);
+        o.ancho = rasterCPU.fb.ancho; o.alto = rasterCPU.fb.alto;
+        o.prims.assign(rasterCPU.prims.begin() + inicioObjetoCPU, rasterCPU.prims.end());
+    }
+    for (size_t i = inicioObjetoCPU; i < rasterCPU.prims.size(); i++) cpuAplicarSesgo(rasterCPU.prims[i], sesgoObjetoCPU);
+}
+
+// UV del vertice (0..1) -> rectangulo de la textura activa
+void aRegionUV(VerticeRaster& v) {
+    v.u = uvCPUActiva[0] + v.u * (uvCPUActiva[2] - uvCPUActiva[0]);
+    v.v = uvCPUActiva[1] + v.v * (uvCPUActiva[3] - uvCPUActiva[1]);
+}
+
+void cpuPrimitiva(PrimitivaDibujo prim, const VerticeRaster* v, int n, const float col[4]) {
+    VerticeRaster w[MAX_VERTICES_PRIM];
+    const TexturaCPU* tex = texturaCPUActiva;
+    for (int i = 0; i < n; i++) {
+        w[i] = aVentana(v[i], rasterCPU.fb);
+        if (tex) aRegionUV(w[i]);
+    }
+    switch (prim) {
+        case R_TRIANGLES:
+            for (int i = 0; i + 2 < n; i += 3) rcTriangulo(rasterCPU, w[i], w[i+1], w[i+2], col, tex);
+            break;
+        case R_QUADS:
+            for (int i = 0; i + 3 < n; i += 4) {
+                rcTriangulo(rasterCPU, w[i], w[i+1], w[i+2], col, tex);
+                rcTriangulo(rasterCPU, w[i], w[i+2], w[i+3], col, tex);
+            }
+            break;
+        case R_POLYGON:   // poligonos convexos: abanico desde el primer vertice
+            for (int i = 1; i + 1 < n; i++) rcTriangulo(rasterCPU, w[0], w[i], w[i+1], col, tex);
+            break;
+        case R_LINES:
+            for (int i = 0; i + 1 < n; i += 2) rcLinea(rasterCPU, w[i], w[i+1], col);
+            break;
+    }
+}
+
+VerticeRaster transformar(const Matriz2D& m, const VerticeRaster& v) {
+    VerticeRaster r = { m.a * v.x + m.c * v.y + m.tx, m.b * v.x + m.d * v.y + m.ty, v.z + m.tz, v.u, v.v };
+    return r;
+}
+
+void cpuSubirMallas(const VerticeRaster*, int) {}   // se leen directo de verticesMallas
+
+void cpuMalla(const Malla& m, const Matriz2D& t, const float col[4]) {
+    const VerticeRaster* v = &verticesMallas[m.primero];
+    const TexturaCPU* tex = texturaCPUActiva;
+    int paso = m.esLineas ? 2 : 3;
+    for (int i = 0; i + paso - 1 < m.cantidad; i += paso) {
+        VerticeRaster w[3];
+        for (int k = 0; k < paso; k++) {
+            w[k] = aVentana(transformar(t, v[i + k]), rasterCPU.fb);
+            if (tex) aRegionUV(w[k]);
+        }
+        if (m.esLineas) rcLinea(rasterCPU, w[0], w[1], col);
+        else rcTriangulo(rasterCPU, w[0], w[1], w[2], col, tex);
+    }
+}
+
+void cpuInstancias(const Malla& m, const Matriz2D& base, float sx, float sy,
+                   const float* x, const float* y, const float* angulo, int n, const float col[4]) {
+    for (int i = 0; i < n; i++) cpuMalla(m, componerInstancia(base, x[i], y[i], angulo[i], sx, sy), col);
+}
+
+void cpuInstanciasMatriz(const Malla& m, const Matriz2D& base, const Matriz2D* t, int n, const float col[4]) {
+    for (int i = 0; i < n; i++) cpuMalla(m, multiplicarMatriz(base, t[i]), col);
+}
+
+void cpuLote(const ElementoLote* e, int n, const float col[4]) {
+    for (int i = 0; i < n; i++) cpuMalla(mallas[e[i].malla], e[i].t, col);
+}
+
+void cpuUsarTextura(unsigned int id, const float uv[4]) {
+    texturaCPUActiva = (id > 0 && id <= texturasCPU.size() && texturasCPU[id - 1].ancho) ? &texturasCPU[id - 1] : NULL;
+    if (uv) memcpy(uvCPUActiva, uv, sizeof(uvCPUActiva));
+}
+
+unsigned int cpuCrearTextura(const uint32_t* const* niveles, int numNiveles, int ancho, int alto) {
+    TexturaCPU t;
+    t.ancho = ancho; t.alto = alto; t.niveles = numNiveles;
+    size_t total = 0;
+    for (int n = 0; n < numNiveles; n++) { t.inicio[n] = total; total += (size_t)dimNivel(ancho, n) * dimNivel(alto, n); }
+    t.texels.resize(total);
+    for (int n = 0; n < numNiveles; n++)
+        memcpy(&t.texels[t.inicio[n]], niveles[n], (size_t)dimNivel(ancho, n) * dimNivel(alto, n) * 4);
+    texturaCPUActiva = NULL;   // el push_back puede mover las texturas existentes
+    for (size_t i = 0; i < texturasCPU.size(); i++)
+        if (texturasCPU[i].ancho == 0) { texturasCPU[i] = std::move(t); return (unsigned int)i + 1; }   // hueco de una liberada
+    texturasCPU.push_back(std::move(t));
+    return (unsigned int)texturasCPU.size();
+}
+
+// La entrada queda vacia (sin texels) para que los demas ids no cambien
+void cpuLiberarTextura(unsigned int id) {
+    if (id == 0 || id > texturasCPU.size()) return;
+    if (texturaCPUActiva == &texturasCPU[id - 1]) texturaCPUActiva = NULL;
+    texturasCPU[id - 1] = TexturaCPU();
+}
+
+void cpuTerminarFrame() {
+    rcFlush(rasterCPU);
+#ifndef SIN_GL
+    if (cpuPresentarEnVentana) {
+        glDisable(GL_DEPTH_TEST);
+        glWindowPos2i(0, 0);
+        glDrawPixels(rasterCPU.fb.ancho, rasterCPU.fb.alto, GL_RGBA, GL_UNSIGNED_BYTE, rasterCPU.fb.color.data());
+        glEnable(GL_DEPTH_TEST);
+    }
+#endif
+}
+
+BackendRender backendCPU = { "cpu", cpuIniciarFrame, cpuPrimitiva, cpuUsarTextura, cpuCrearTextura,
+                              cpuLiberarTextura, cpuSubirMallas, cpuMalla, cpuInstancias, cpuInstanciasMatriz, cpuLote, cpuTerminarFrame,
+                              cpuRepetirObjeto, cpuComenzarObjeto, cpuTerminarObjeto };
+
+// hilos <= 0 usa todos los nucleos
+void backendCPUIniciar(int ancho, int alto, int hilos, int presentarEnVentana) {
+    poolIniciar(poolRaster, hilos <= 0 ? -1 : hilos - 1);
+    rcCrear(rasterCPU, ancho, alto, &poolRaster);
+    cpuPresentarEnVentana = presentarEnVentana;
+}
+
+// --- BACKEND OPENGL ---
+#ifndef SIN_GL
+
+GLuint vboMallas = 0, vaoMallas = 0;
+int oglMatrizMalla = 0;       // la modelview tiene cargada la transformacion de una malla
+GLuint vboInstancias = 0, progInstancias = 0, progInstanciasMatriz = 0;
+GLuint vboLote = 0, vaoLote = 0;
+std::vector<VerticeRaster> verticesLote;
+GLint uniEscalaInstancias = -1;
+
+// Las instancias necesitan un shader minimo: el pipeline fijo no sabe leer
+// atributos por instancia. Usa el vertice, el color y las matrices del
+// perfil de compatibilidad, asi convive con el resto del dibujo inmediato.
+static const char* FUENTE_VS_INSTANCIAS =
+    "#version 330 compatibility\n"
+    "layout(location = 1) in float instX;\n"
+    "layout(location = 2) in float instY;\n"
+    "layout(location = 3) in float instAngulo;\n"
+    "uniform vec2 escala;\n"
+    "void main() {\n"
+    "    vec2 p = gl_Vertex.xy * escala;\n"
+    "    float c = cos(instAngulo), s = sin(instAngulo);\n"
+    "    p = vec2(c * p.x - s * p.y + instX, s * p.x + c * p.y + instY);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, gl_Vertex.z, 1.0);\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "}\n";
+// Variante con la matriz completa por instancia: columnas (a,b) y (c,d) y traslacion
+static const char* FUENTE_VS_INSTANCIAS_MATRIZ =
+    "#version 330 compatibility\n"
+    "layout(location = 1) in vec4 instLineal;\n"
+    "layout(location = 2) in vec3 instTraslacion;\n"
+    "void main() {\n"
+    "    vec2 p = instLineal.xy * gl_Vertex.x + instLineal.zw * gl_Vertex.y + instTraslacion.xy;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, gl_Vertex.z + instTraslacion.z, 1.0);\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "}\n";
+static const char* FUENTE_FS_INSTANCIAS =
+    "#version 330 compatibility\n"
+    "void main() { gl_FragColor = gl_Color; }\n";
+
+GLuint oglCompilar(GLenum tipo, const char* fuente) {
+    GLuint sh = glCreateShader(tipo);
+    glShaderSource(sh, 1, &fuente, NULL);
+    glCompileShader(sh);
+    GLint ok = 0;
+    glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[512];
+        glGetShaderInfoLog(sh, sizeof(log), NULL, log);
+        printf(">> ERROR: shader de instancias: %s\n", log);
+    }
+    return sh;
+}
+
+void oglIniciarFrame(const float fondo[3]) {
+    glClearColor(fondo[0], fondo[1], fondo[2], 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0, 100.0, 0.0, 100.0, -10.0, 10.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    oglMatrizMalla = 0;
+}
+
+void oglPrimitiva(PrimitivaDibujo prim, const VerticeRaster* v, int n, const float col[4]) {
+    static const GLenum modosGL[] = { GL_TRIANGLES, GL_QUADS, GL_POLYGON, GL_LINES };
+    if (oglMatrizMalla) { glLoadIdentity(); oglMatrizMalla = 0; }
+    glColor4fv(col);
+    glBegin(modosGL[prim]);
+    for (int i = 0; i < n; i++) {
+        glTexCoord2f(v[i].u, v[i].v);
+        glVertex3f(v[i].x, v[i].y, v[i].z);
+    }
+    glEnd();
+}
+
+// El rectangulo del sprite va en la matriz de textura, asi las mallas del VBO no cambian
+void oglUsarTextura(unsigned int id, const float uv[4]) {
+    if (!id) { glDisable(GL_TEXTURE_2D); return; }
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glTranslatef(uv[0], uv[1], 0.0f);
+    glScalef(uv[2] - uv[0], uv[3] - uv[1], 1.0f);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+unsigned int oglCrearTextura(const uint32_t* const* niveles, int numNiveles, int ancho, int alto) {
+    GLuint id = 0;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, numNiveles > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numNiveles - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int n = 0; n < numNiveles; n++)
+        glTexImage2D(GL_TEXTURE_2D, n, GL_RGBA, dimNivel(ancho, n), dimNivel(alto, n), 0, GL_RGBA, GL_UNSIGNED_BYTE, niveles[n]);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    return id;
+}
+
+void oglLiberarTextura(unsigned int id) {
+    GLuint t = id;
+    glDeleteTextures(1, &t);
+}
+
+GLuint oglEnlazar(const char* fuenteVS, const char* fuenteFS) {
+    GLuint prog = glCreateProgram();
+    GLuint vs = oglCompilar(GL_VERTEX_SHADER, fuenteVS);
+    GLuint fs = oglCompilar(GL_FRAGMENT_SHADER, fuenteFS);
+    glAttachShader(prog, vs);
+    glAttachShader(prog, fs);
+    glLinkProgram(prog);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return prog;
+}
+
+// Todas las mallas van en un unico VBO; el VAO guarda los punteros de
+// vertice y coordenada de textura (perfil de compatibilidad)
+void oglSubirMallas(const VerticeRaster* v, int n) {
+    glGenVertexArrays(1, &vaoMallas);
+    glBindVertexArray(vaoMallas);
+    glGenBuffers(1, &vboMallas);
+    glBindBuffer(GL_ARRAY_BUFFER, vboMallas);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)n * sizeof(VerticeRaster), v, GL_STATIC_DRAW);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(VerticeRaster), (void*)0);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(VerticeRaster), (void*)(3 * sizeof(float)));
+
+    // Buffer de instancias: x, y y angulo uno detras del otro, un atributo cada uno
+    glGenBuffers(1, &vboInstancias);
+    for (int i = 1; i <= 3; i++) glVertexAttribDivisor(i, 1);
+
+    progInstancias = oglEnlazar(FUENTE_VS_INSTANCIAS, FUENTE_FS_INSTANCIAS);
+    progInstanciasMatriz = oglEnlazar(FUENTE_VS_INSTANCIAS_MATRIZ, FUENTE_FS_INSTANCIAS);
+    uniEscalaInstancias = glGetUniformLocation(progInstancias, "escala");
+
+    // Lotes: vertices ya transformados en la CPU, en un buffer que se rellena por tanda
+    glGenVertexArrays(1, &vaoLote);
+    glBindVertexArray(vaoLote);
+    glGenBuffers(1, &vboLote);
+    glBindBuffer(GL_ARRAY_BUFFER, vboLote);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(VerticeRaster), (void*)0);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(VerticeRaster), (void*)(3 * sizeof(float)));
+    glBindVertexArray(vaoMallas);
+    glBindBuffer(GL_ARRAY_BUFFER, vboMallas);
+}
+
+void oglMalla(const Malla& m, const Matriz2D& t, const float col[4]) {
+    GLfloat mat[16] = { t.a, t.b, 0.0f, 0.0f,   t.c, t.d, 0.0f, 0.0f,
+                        0.0f, 0.0f, 1.0f, 0.0f, t.tx, t.ty, t.tz, 1.0f };
+    glLoadMatrixf(mat);
+    oglMatrizMalla = 1;
+    glColor4fv(col);
+    glDrawArrays(m.esLineas ? GL_LINES : GL_TRIANGLES, m.primero, m.cantidad);
+}
+
+void oglInstancias(const Malla& m, const Matriz2D& base, float sx, float sy,
+                   const float* x, const float* y, const float* angulo, int n, const float col[4]) {
+    GLsizeiptr bytes = (GLsizeiptr)n * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, vboInstancias);
+    glBufferData(GL_ARRAY_BUFFER, 3 * bytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, x);
+    glBufferSubData(GL_ARRAY_BUFFER, bytes, bytes, y);
+    glBufferSubData(GL_ARRAY_BUFFER, 2 * bytes, bytes, angulo);
+    for (int i = 0; i < 3; i++) {
+        glEnableVertexAttribArray(1 + i);
+        glVertexAttribPointer(1 + i, 1, GL_FLOAT, GL_FALSE, 0, (void*)(i * bytes));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vboMallas);
+
+    GLfloat mat[16] = { base.a, base.b, 0.0f, 0.0f,   base.c, base.d, 0.0f, 0.0f,
+                        0.0f, 0.0f, 1.0f, 0.0f, base.tx, base.ty, base.tz, 1.0f };
+    glLoadMatrixf(mat);
+    oglMatrizMalla = 1;
+    glColor4fv(col);
+    glUseProgram(progInstancias);
+    glUniform2f(uniEscalaInstancias, sx, sy);
+    glDrawArraysInstanced(m.esLineas ? GL_LINES : GL_TRIANGLES, m.primero, m.cantidad, n);
+    glUseProgram(0);
+    for (int i = 1; i <= 3; i++) glDisableVertexAttribArray(i);
+}
+
+void oglInstanciasMatriz(const Malla& m, const Matriz2D& base, const Matriz2D* t, int n, const float col[4]) {
+    glBindBuffer(GL_ARRAY_BUFFER, vboInstancias);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)n * sizeof(Matriz2D), t, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Matriz2D), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Matriz2D), (void*)(4 * sizeof(float)));
+    glBindBuffer(GL_ARRAY_BUFFER, vboMallas);
+
+    GLfloat mat[16] = { base.a, base.b, 0.0f, 0.0f,   base.c, base.d, 0.0f, 0.0f,
+                        0.0f, 0.0f, 1.0f, 0.0f, base.tx, base.ty, base.tz, 1.0f };
+    glLoadMatrixf(mat);
+    oglMatrizMalla = 1;
+    glColor4fv(col);
+    glUseProgram(progInstanciasMatriz);
+    glDrawArraysInstanced(m.esLineas ? GL_LINES : GL_TRIANGLES, m.primero, m.cantidad, n);
+    glUseProgram(0);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(2);
+}
+
+// Triangulos primero y lineas al final del mismo buffer: dos llamadas por
+// lote como mucho. El orden entre ellos lo resuelve el sesgo de z.
+void oglLote(const ElementoLote* e, int n, const float col[4]) {
+    verticesLote.clear();
+    int numTri = 0;
+    for (int lineas = 0; lineas < 2; lineas++) {
+        for (int i = 0; i < n; i++) {
+            const Malla& m = mallas[e[i].malla];
+            if (m.esLineas != lineas) continue;
+            for (int k = 0; k < m.cantidad; k++) verticesLote.push_back(transformar(e[i].t, verticesMallas[m.primero + k]));
+        }
+        if (lineas == 0) numTri = (int)verticesLote.size();
+    }
+    int numLin = (int)verticesLote.size() - numTri;
+
+    if (oglMatrizMalla) { glLoadIdentity(); oglMatrizMalla = 0; }
+    glColor4fv(col);
+    glBindVertexArray(vaoLote);
+    glBindBuffer(GL_ARRAY_BUFFER, vboLote);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)verticesLote.size() * sizeof(VerticeRaster), verticesLote.data(), GL_STREAM_DRAW);
+    if (numTri) glDrawArrays(GL_TRIANGLES, 0, numTri);
+    if (numLin) glDrawArrays(GL_LINES, numTri, numLin);
+    glBindVertexArray(vaoMallas);
+    glBindBuffer(GL_ARRAY_BUFFER, vboMallas);
+}
+
+void oglTerminarFrame() {}
+
+// Sin objetos grabados: el back buffer se redibuja entero en cada swap
+BackendRender backendGL = { "gl", oglIniciarFrame, oglPrimitiva, oglUsarTextura, oglCrearTextura,
+                            oglLiberarTextura, oglSubirMallas, oglMalla, oglInstancias, oglInstanciasMatriz, oglLote, oglTerminarFrame,
+                            NULL, NULL, NULL };
+
+#endif
@@ -0,0 +1,136 @@
+// textura_horneada.h - Texturas preprocesadas (.ltex) que se mapean en memoria
+//
+// Un .ltex guarda la imagen ya como RGBA8, con la fila 0 abajo (el orden
+// que esperan glTexImage2D y el rasterizador), detras de una cabecera fija.
+// Al arrancar se mapea el archivo y los texels se pasan tal cual al
+// backend: no hay JPEG que decodificar ni buffer intermedio.
+//
+// Se genera una vez con  gpc_project-2d --hornear plumas.jpg plumas.ltex
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LTEX_VERSION 1
+#define LTEX_MAX_NIVELES 16
+#define LTEX_ALINEACION 64         // cada nivel empieza alineado a una linea de cache
+
+typedef enum { LTEX_RGBA8 = 0 } FormatoLtex;
+
+// Todo en little endian. desplazamiento[n] es el byte donde empieza el nivel n
+typedef struct {
+    char magia[4];                 // "LTEX"
+    uint32_t version;
+    uint32_t formato;
+    uint32_t ancho, alto;
+    uint32_t niveles;
+    uint64_t desplazamiento[LTEX_MAX_NIVELES];
+} CabeceraLtex;
+
+struct ArchivoMapeado {
+    const unsigned char* datos = nullptr;
+    size_t tamano = 0;
+#ifdef _WIN32
+    HANDLE archivo = INVALID_HANDLE_VALUE, mapeo = NULL;
+#endif
+};
+
+inline int mapearArchivo(const char* ruta, ArchivoMapeado& m) {
+#ifdef _WIN32
+    m.archivo = CreateFileA(ruta, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m.archivo == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER tam;
+    if (!GetFileSizeEx(m.archivo, &tam) || tam.QuadPart == 0) { CloseHandle(m.archivo); m.archivo = INVALID_HANDLE_VALUE; return 0; }
+    m.mapeo = CreateFileMappingA(m.archivo, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m.mapeo) { CloseHandle(m.archivo); m.archivo = INVALID_HANDLE_VALUE; return 0; }
+    m.datos = (const unsigned char*)MapViewOfFile(m.mapeo, FILE_MAP_READ, 0, 0, 0);
+    m.tamano = (size_t)tam.QuadPart;
+    if (!m.datos) { CloseHandle(m.mapeo); CloseHandle(m.archivo); m.mapeo = NULL; m.archivo = INVALID_HANDLE_VALUE; return 0; }
+    return 1;
+#else
+    int fd = open(ruta, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return 0; }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);                     // el mapeo sigue valido sin el descriptor
+    if (p == MAP_FAILED) return 0;
+    m.datos = (const unsigned char*)p;
+    m.tamano = (size_t)st.st_size;
+    return 1;
+#endif
+}
+
+inline void desmapearArchivo(ArchivoMapeado& m) {
+    if (!m.datos) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m.datos);
+    CloseHandle(m.mapeo);
+    CloseHandle(m.archivo);
+    m.mapeo = NULL; m.archivo = INVALID_HANDLE_VALUE;
+#else
+    munmap((void*)m.datos, m.tamano);
+#endif
+    m.datos = nullptr; m.tamano = 0;
+}
+
+inline int tamanoNivel(int ancho, int alto, int nivel) {
+    int w = ancho >> nivel, h = alto >> nivel;
+    return (w > 0 ? w : 1) * (h > 0 ? h : 1) * 4;
+}
+
+// Comprueba la cabecera y que todos los niveles esten dentro del archivo.
+// Devuelve la cabecera o NULL si el archivo no es un .ltex valido.
+inline const CabeceraLtex* validarLtex(const ArchivoMapeado& m) {
+    if (m.tamano < sizeof(CabeceraLtex)) return NULL;
+    const CabeceraLtex* c = (const CabeceraLtex*)m.datos;
+    if (memcmp(c->magia, "LTEX", 4) != 0 || c->version != LTEX_VERSION || c->formato != LTEX_RGBA8) return NULL;
+    if (c->ancho == 0 || c->alto == 0 || c->ancho > 16384 || c->alto > 16384) return NULL;
+    if (c->niveles == 0 || c->niveles > LTEX_MAX_NIVELES) return NULL;
+    for (uint32_t n = 0; n < c->niveles; n++) {
+        uint64_t fin = c->desplazamiento[n] + (uint64_t)tamanoNivel(c->ancho, c->alto, n);
+        if (c->desplazamiento[n] % LTEX_ALINEACION || fin > m.tamano) return NULL;
+    }
+    return c;
+}
+
+// Escribe un .ltex. niveles[n] son los texels RGBA8 del nivel n (fila 0 abajo)
+inline int escribirLtex(const char* ruta, int ancho, int alto, const unsigned char* const* niveles, int numNiveles) {
+    if (numNiveles < 1 || numNiveles > LTEX_MAX_NIVELES) return 0;
+    CabeceraLtex c;
+    memset(&c, 0, sizeof(c));
+    memcpy(c.magia, "LTEX", 4);
+    c.version = LTEX_VERSION; c.formato = LTEX_RGBA8;
+    c.ancho = ancho; c.alto = alto; c.niveles = numNiveles;
+    uint64_t pos = sizeof(CabeceraLtex);
+    for (int n = 0; n < numNiveles; n++) {
+        pos = (pos + LTEX_ALINEACION - 1) / LTEX_ALINEACION * LTEX_ALINEACION;
+        c.desplazamiento[n] = pos;
+        pos += tamanoNivel(ancho, alto, n);
+    }
+    FILE* f = fopen(ruta, "wb");
+    if (!f) return 0;
+    fwrite(&c, sizeof(c), 1, f);
+    static const unsigned char ceros[LTEX_ALINEACION] = {0};
+    uint64_t escrito = sizeof(c);
+    for (int n = 0; n < numNiveles; n++) {
+        fwrite(ceros, 1, (size_t)(c.desplazamiento[n] - escrito), f);
+        fwrite(niveles[n], 1, tamanoNivel(ancho, alto, n), f);
+        escrito = c.desplazamiento[n] + tamanoNivel(ancho, alto, n);
+    }
+    int ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,96 @@
+// vigilancia.h - Aviso de archivos modificados, sin bloquear
+//
+// vigCambios() se llama una vez por frame y devuelve que archivos se
+// terminaron de escribir desde la llamada anterior. En Linux se usa inotify
+// sobre el directorio de cada archivo (IN_CLOSE_WRITE y IN_MOVED_TO), asi
+// tambien se ven los editores que guardan escribiendo otro archivo y
+// renombrandolo encima; el descriptor no bloquea y leerlo cuesta una llamada
+// al sistema. En el resto se compara la fecha de modificacion, como mucho dos
+// veces por segundo.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define VIG_MAX_ARCHIVOS 32
+
+struct Vigilancia {
+    std::vector<std::string> rutas;
+    std::vector<int64_t> fechas;               // sondeo: ultima fecha de modificacion vista
+    std::chrono::steady_clock::time_point ultimoSondeo;
+#ifdef __linux__
+    int fd = -1;
+    std::vector<int> directorio;               // por archivo: descriptor de vigilancia de su directorio
+    std::vector<std::string> nombre;           // por archivo: nombre dentro del directorio
+#endif
+};
+
+inline int64_t fechaModificacion(const char* ruta) {
+    struct stat st;
+    return stat(ruta, &st) == 0 ? (int64_t)st.st_mtime : -1;
+}
+
+// Devuelve el indice del archivo (el bit en vigCambios) o -1
+inline int vigAgregar(Vigilancia& v, const char* ruta) {
+    if (v.rutas.size() >= VIG_MAX_ARCHIVOS) return -1;
+    std::string r = ruta;
+    v.rutas.push_back(r);
+    v.fechas.push_back(fechaModificacion(ruta));
+#ifdef __linux__
+    if (v.fd < 0) v.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    size_t barra = r.rfind('/');
+    std::string dir = barra == std::string::npos ? "." : (barra == 0 ? "/" : r.substr(0, barra));
+    v.nombre.push_back(barra == std::string::npos ? r : r.substr(barra + 1));
+    // el mismo directorio da el mismo descriptor: no hace falta deduplicar
+    v.directorio.push_back(v.fd >= 0 ? inotify_add_watch(v.fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) : -1);
+#endif
+    return (int)v.rutas.size() - 1;
+}
+
+// Bit i encendido = el archivo i cambio
+inline uint32_t vigCambios(Vigilancia& v) {
+    uint32_t cambios = 0;
+#ifdef __linux__
+    if (v.fd >= 0) {
+        alignas(struct inotify_event) char buf[4096];
+        for (;;) {
+            ssize_t n = read(v.fd, buf, sizeof(buf));
+            if (n <= 0) break;
+            for (char* p = buf; p < buf + n; ) {
+                const struct inotify_event* ev = (const struct inotify_event*)p;
+                if (ev->len > 0)
+                    for (size_t i = 0; i < v.rutas.size(); i++)
+                        if (v.directorio[i] == ev->wd && v.nombre[i] == ev->name) cambios |= 1u << i;
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+        return cambios;
+    }
+#endif
+    auto ahora = std::chrono::steady_clock::now();
+    if (ahora - v.ultimoSondeo < std::chrono::milliseconds(500)) return 0;
+    v.ultimoSondeo = ahora;
+    for (size_t i = 0; i < v.rutas.size(); i++) {
+        int64_t f = fechaModificacion(v.rutas[i].c_str());
+        if (f != v.fechas[i]) { v.fechas[i] = f; if (f >= 0) cambios |= 1u << i; }
+    }
+    return cambios;
+}
+
+inline void vigDetener(Vigilancia& v) {
+#ifdef __linux__
+    if (v.fd >= 0) close(v.fd);
+    v.fd = -1;
+    v.directorio.clear(); v.nombre.clear();
+#endif
+    v.rutas.clear(); v.fechas.clear();
+}